@@ -62,96 +62,592 @@
  ***************************************************************************
  */
 
+#include "checkpoint.h"
+#include "convert.h"
+#include "daemon.h"
+#include "decimate.h"
+#include "hash.h"
+#include "npy.h"
+#include "progress.h"
+#include "quantile.h"
+#include "rowindex.h"
+#include "stats.h"
+#include "uring.h"
 #include "xml.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #if !defined(__APPLE__) && !defined(__MACH__) && !defined(__APPLE_CC__)
 #include <malloc.h>
 #endif
 
-#define MAX_PATH_LENGTH 1024
-#define MAX_EDF_SIGNALS 128
-
-void latin1_to_ascii(char *, int);
-int loadTemplate(char * path);
-void initSignalTable();
-
-char separator; /* CSV file separator */
-int columns; /* number of columns in csv */
-int startline; /* which line of csv data starts */
-double samplefrequency; /* frequency of csv samples */
-int autoPhysicalMaximum; /* should physical maxima be autodetected */
-int edf_format; /* edf/bdf format switch */
-int edfsignals; /* how many signals are to be output */
-
-/* Per signal info from template */
-double physmax[MAX_EDF_SIGNALS];
-double multiplier[MAX_EDF_SIGNALS];
-double sensitivity[MAX_EDF_SIGNALS];
-char signames[128][MAX_EDF_SIGNALS];
-char sigdimensions[128][MAX_EDF_SIGNALS];
-int column_enabled[MAX_EDF_SIGNALS];
+/* Bytes read per block when estimating the physical maxima from samples */
+#define PHYSMAX_SAMPLE_BLOCK 65536
 
-int main(int argc, char *argv[]) {
+/* Largest datarecord the EDF specification recommends */
+#define EDF_MAX_RECORD_SIZE 61440
+
+/* Template/output pairs written in one pass, the first one included */
+#define MAX_OUTPUTS 16
+
+/* Loaded templates the daemon keeps, by path, size and modification time */
+#define TEMPLATE_CACHE_SIZE 32
+
+/*
+ * One output of a conversion.  All outputs share the parsed rows; src maps
+ * the signals of this output to the values parsed for all of them.
+ */
+struct conv_sink {
+	struct conv_template tpl;
+	char template_path[MAX_PATH_LENGTH];
+	char outputfilename[MAX_PATH_LENGTH];
+	int src[MAX_EDF_SIGNALS];
+	long long clips[MAX_EDF_SIGNALS];
+};
+
+struct conv_job {
+	char path[MAX_PATH_LENGTH];
+	char template_path[MAX_PATH_LENGTH];
+	char patient_name[128];
+	char recording[128];
+	char outputfilename[MAX_PATH_LENGTH];
+	int year, month, day, hour, minute, second;
+
+	int physmax_samples; /* blocks to estimate physmax from, 0 for a full scan */
+	int physmax_random; /* random instead of evenly spaced blocks */
+	double physmax_headroom; /* factor applied to estimated maxima */
+	int physmax_fallback; /* rescan and convert again if an estimate clips */
+	double physmax_percentile; /* of the absolute values, 0 for the maximum */
+
+	double decimate_to; /* output sample rate, 0 to keep the input rate */
+
+	double split_seconds; /* segment duration, 0 for no split by duration */
+	long long split_bytes; /* maximum segment size, 0 for no split by size */
+	int workers; /* threads writing segments */
+
+	long long record_size; /* maximum datarecord size, 0 for the default */
+	long long record_align; /* datarecord size multiple, 0 for none */
+
+	int io; /* IO_STDIO, IO_URING or IO_URING_DIRECT */
+
+	const char *also[MAX_OUTPUTS - 1]; /* "<template>,<output>" pairs */
+	int nsinks; /* outputs, 1 + the number of pairs */
+
+	FILE *stats_out; /* where --stats reports go */
+
+	int checkpoint_seconds; /* between checkpoints, 0 for none */
+	int resume; /* continue from the checkpoint of an earlier run */
+
+	int index; /* keep a row index next to the csv file */
 
-	int i, j, k, p, column, column_end, headersize, temp, datarecords,
-			str_start, line_nr, smpls_per_block = 0, bufsize = 0, edf_signal,
-			len;
+	double from, to; /* range to convert, to < 0 for the end */
+	int from_rows, to_rows; /* given in rows rather than seconds */
 
-	char path[MAX_PATH_LENGTH], template_path[MAX_PATH_LENGTH],
-			patient_name[128], recording[128], str[256], line[2048], *buf,
-			scratchpad[128], outputfilename[MAX_PATH_LENGTH];
+	int exact_integers; /* round integer columns exactly */
+
+	int signal_stats; /* write <output>.stats.json for every output file */
+
+	int hash; /* HASH_NONE or the algorithm of <output>.hash */
+
+	long long max_memory; /* for buffers, 0 for no limit */
+
+	/* derived from the template */
+	struct conv_sink *sinks;
+	struct npy_array npy; /* type BINARY_NONE unless reading a NumPy array */
+	int decimate; /* decimation factor, 1 for none */
+	int resuming; /* a checkpoint is being continued */
+	struct row_index *row_index; /* NULL if the rows are not indexed */
+	long long first_row; /* first row read, filter warm-up included */
+	long long first_offset; /* of first_row, headersize excluded */
+	long long start_row; /* first row converted */
+	long long end_row; /* one past the last row converted, -1 for the end */
+	long long range_size; /* bytes from first_offset to end_row */
+	long long start_seconds; /* of start_row, after the header start time */
+	int smpls_per_block;
 	double datrecduration;
-	int day, month, year, hour, minute, second;
+};
 
-	double value[MAX_EDF_SIGNALS];
-	FILE *inputfile, *outputfile;
+int convert(struct conv_job *job, struct conv_stats *stats,
+		struct conv_progress *progress);
 
-	if (argc != 12) {
-		printf( "ASCII to EDF(+) or BDF(+) converter\n"
-						"Usage: ascii2edf <csv_file> <template_file> <subject_name> <recording_name> <year> <month> <day> <hour> <minute> <second> <outputfilename>\n\n");
+struct cached_template {
+	char path[MAX_PATH_LENGTH];
+	struct timespec mtime;
+	off_t size;
+	long long used; /* template_uses when last used, 0 for a free slot */
+	struct conv_template tpl;
+};
+
+/* Only set in daemon mode, where the same templates are loaded over and over */
+static struct cached_template *template_cache;
+static long long template_uses;
+static pthread_mutex_t template_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Parses a position in the csv data: seconds, optionally followed by s, or
+ * a row number followed by r.  Returns 0 if it is valid.
+ */
+static int parse_position(const char *str, double *value, int *rows) {
+	char *end;
+
+	*value = strtod(str, &end);
+	*rows = (*end == 'r');
+	if (*end == 'r' || *end == 's') {
+		end++;
+	}
+
+	return end == str || *end != 0 || *value < 0
+			|| (*rows && *value != floor(*value));
+}
+
+/* Parses a byte count with an optional k, M or G suffix */
+long long parse_size(const char *str) {
+	char *end;
+	long long size = strtoll(str, &end, 10);
+
+	switch (*end) {
+	case 'k': case 'K': return size << 10;
+	case 'm': case 'M': return size << 20;
+	case 'g': case 'G': return size << 30;
+	case 0: return size;
+	default: return -1;
+	}
+}
+
+void usage() {
+	printf( "ASCII to EDF(+) or BDF(+) converter\n"
+			"Usage: ascii2edf [options] <csv_file> <template_file> <subject_name> <recording_name> <year> <month> <day> <hour> <minute> <second> <outputfilename>\n\n"
+			"Options:\n"
+			"  --stats[=json]               report timings, throughput, clip counts and memory use on stderr\n"
+			"  --progress-fd=<fd>           write JSON progress lines to an open file descriptor\n"
+			"  --progress-socket=<path>     write JSON progress lines to a Unix socket\n"
+			"  --progress-interval=<ms>     interval between progress lines (default 1000)\n"
+			"  --physmax-sample=<n>[,random]\n"
+			"                               estimate physical maxima from n evenly spaced (or random)\n"
+			"                               blocks instead of scanning the whole file\n"
+			"  --physmax-headroom=<factor>  headroom applied to estimated maxima and percentiles (default 1.25)\n"
+			"  --physmax-fallback           scan the whole file and convert again if an estimate clips\n"
+			"  --physmax-percentile=<p>     set physical maxima from the p-th percentile of the absolute\n"
+			"                               values, such as 99.99, so that spikes clip\n"
+			"  --decimate-to=<Hz>           low-pass filter and decimate to a sample rate which divides\n"
+			"                               the template samplefrequency\n"
+			"  --split-duration=<seconds>   write segments of the given duration, named <output>_001.edf etc.\n"
+			"  --split-size=<bytes>[k|M|G]  write segments of at most the given size\n"
+			"  --jobs=<n>                   segments written in parallel (default: number of cpus)\n"
+			"  --record-size=<bytes>[k|M]   use the largest datarecords up to the given size\n"
+			"  --record-align=<bytes>[k|M]  make the datarecord size a multiple of the given size\n"
+			"  --io=uring[,direct]          read and write with io_uring, output optionally with O_DIRECT\n"
+			"  --also=<template>,<output>   write another output from the same csv rows\n"
+			"  --checkpoint[=<seconds>]     save the state to <output>.ckpt every so often (default 60)\n"
+			"  --resume                     continue from <output>.ckpt if an earlier run left one\n"
+			"  --index                      keep a row index in <csv_file>.idx and reuse it\n"
+			"  --from=<seconds>|<row>r      start the conversion at the given time or row\n"
+			"  --to=<seconds>|<row>r        end the conversion before the given time or row\n"
+			"  --exact-integers             scale columns of integers exactly and round the samples\n"
+			"  --signal-stats               write min, max, mean, rms, NaN and clip counts of every signal\n"
+			"                               to <output>.stats.json\n"
+			"  --hash=sha256|xxh64          hash every output file while writing it, into <output>.hash\n"
+			"  --max-memory=<bytes>[k|M|G]  size datarecords, i/o buffers and split jobs to fit the given memory\n\n"
+			"Daemon mode: ascii2edf --daemon=<socket> [--max-jobs=<n>]\n"
+			"  runs the jobs sent to a Unix socket, one tab-separated argument list per line,\n"
+			"  at most n at a time (default: number of cpus)\n\n");
+}
+
+/*
+ * Reads the options and arguments of a conversion, argv[0] being the first
+ * of them.  Returns 0 if they are valid.
+ */
+static int parse_args(int argc, char *argv[], struct conv_job *job,
+		struct conv_stats *stats, struct conv_progress *progress,
+		char **progress_socket) {
+	int i, nargs;
+	char *args[11];
+
+	stats_init(stats, STATS_OFF);
+	progress_init(progress);
+	memset(job, 0, sizeof(struct conv_job));
+	job->physmax_headroom = 1.25;
+	job->to = -1.0;
+	job->decimate = 1;
+	job->nsinks = 1;
+	job->workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (job->workers < 1) {
+		job->workers = 1;
+	}
+
+	for (i = 0, nargs = 0; i < argc; i++) {
+		if (!strncmp(argv[i], "--", 2)) {
+			if (!strcmp(argv[i], "--stats")) {
+				stats->mode = STATS_TEXT;
+			} else if (!strcmp(argv[i], "--stats=json")) {
+				stats->mode = STATS_JSON;
+			} else if (!strncmp(argv[i], "--progress-fd=", 14)) {
+				progress->fd = atoi(argv[i] + 14);
+			} else if (!strncmp(argv[i], "--progress-socket=", 18)) {
+				*progress_socket = argv[i] + 18;
+			} else if (!strncmp(argv[i], "--progress-interval=", 20)) {
+				progress->interval_ms = atoi(argv[i] + 20);
+				if (progress->interval_ms < 1) {
+					printf("Invalid progress interval");
+					return 1;
+				}
+			} else if (!strncmp(argv[i], "--physmax-sample=", 17)) {
+				job->physmax_samples = atoi(argv[i] + 17);
+				job->physmax_random = (strstr(argv[i], ",random") != NULL);
+				if (job->physmax_samples < 1) {
+					printf("Invalid number of physmax samples");
+					return 1;
+				}
+			} else if (!strncmp(argv[i], "--physmax-headroom=", 19)) {
+				job->physmax_headroom = atof(argv[i] + 19);
+				if (job->physmax_headroom < 1.0) {
+					printf("Physmax headroom must be at least 1");
+					return 1;
+				}
+			} else if (!strcmp(argv[i], "--physmax-fallback")) {
+				job->physmax_fallback = 1;
+			} else if (!strncmp(argv[i], "--physmax-percentile=", 21)) {
+				job->physmax_percentile = atof(argv[i] + 21);
+				if (job->physmax_percentile <= 0.0
+						|| job->physmax_percentile > 100.0) {
+					printf("Invalid physmax percentile");
+					return 1;
+				}
+			} else if (!strncmp(argv[i], "--decimate-to=", 14)) {
+				job->decimate_to = atof(argv[i] + 14);
+				if (job->decimate_to <= 0.0) {
+					printf("Invalid decimated sample rate");
+					return 1;
+				}
+			} else if (!strncmp(argv[i], "--split-duration=", 17)) {
+				job->split_seconds = atof(argv[i] + 17);
+				if (job->split_seconds <= 0.0) {
+					printf("Invalid split duration");
+					return 1;
+				}
+			} else if (!strncmp(argv[i], "--split-size=", 13)) {
+				job->split_bytes = parse_size(argv[i] + 13);
+				if (job->split_bytes <= 0) {
+					printf("Invalid split size");
+					return 1;
+				}
+			} else if (!strncmp(argv[i], "--max-memory=", 13)) {
+				job->max_memory = parse_size(argv[i] + 13);
+				if (job->max_memory <= 0) {
+					printf("Invalid memory size");
+					return 1;
+				}
+			} else if (!strncmp(argv[i], "--jobs=", 7)) {
+				job->workers = atoi(argv[i] + 7);
+				if (job->workers < 1) {
+					printf("Invalid number of jobs");
+					return 1;
+				}
+			} else if (!strncmp(argv[i], "--record-size=", 14)) {
+				job->record_size = parse_size(argv[i] + 14);
+				if (job->record_size <= 0) {
+					printf("Invalid datarecord size");
+					return 1;
+				}
+			} else if (!strncmp(argv[i], "--record-align=", 15)) {
+				job->record_align = parse_size(argv[i] + 15);
+				if (job->record_align <= 0) {
+					printf("Invalid datarecord alignment");
+					return 1;
+				}
+			} else if (!strncmp(argv[i], "--also=", 7)) {
+				if (strchr(argv[i] + 7, ',') == NULL) {
+					printf("Invalid output %s", argv[i] + 7);
+					return 1;
+				}
+				if (job->nsinks >= MAX_OUTPUTS) {
+					printf("Too many outputs");
+					return 1;
+				}
+				job->also[job->nsinks++ - 1] = argv[i] + 7;
+			} else if (!strcmp(argv[i], "--checkpoint")) {
+				job->checkpoint_seconds = CHECKPOINT_INTERVAL;
+			} else if (!strncmp(argv[i], "--checkpoint=", 13)) {
+				job->checkpoint_seconds = atoi(argv[i] + 13);
+				if (job->checkpoint_seconds < 1) {
+					printf("Invalid checkpoint interval");
+					return 1;
+				}
+			} else if (!strcmp(argv[i], "--resume")) {
+				job->resume = 1;
+			} else if (!strcmp(argv[i], "--index")) {
+				job->index = 1;
+			} else if (!strncmp(argv[i], "--from=", 7)) {
+				if (parse_position(argv[i] + 7, &job->from, &job->from_rows)) {
+					printf("Invalid start %s", argv[i] + 7);
+					return 1;
+				}
+			} else if (!strncmp(argv[i], "--to=", 5)) {
+				if (parse_position(argv[i] + 5, &job->to, &job->to_rows)) {
+					printf("Invalid end %s", argv[i] + 5);
+					return 1;
+				}
+			} else if (!strcmp(argv[i], "--exact-integers")) {
+				job->exact_integers = 1;
+			} else if (!strcmp(argv[i], "--signal-stats")) {
+				job->signal_stats = 1;
+			} else if (!strncmp(argv[i], "--hash=", 7)) {
+				job->hash = hash_algorithm(argv[i] + 7);
+				if (job->hash < 0) {
+					printf("Unknown hash %s", argv[i] + 7);
+					return 1;
+				}
+			} else if (!strcmp(argv[i], "--io=stdio")) {
+				job->io = IO_STDIO;
+			} else if (!strcmp(argv[i], "--io=uring")) {
+				job->io = IO_URING;
+			} else if (!strcmp(argv[i], "--io=uring,direct")) {
+				job->io = IO_URING_DIRECT;
+			} else {
+				printf("Unknown option %s\n", argv[i]);
+				usage();
+				return 1;
+			}
+		} else if (nargs < 11) {
+			args[nargs++] = argv[i];
+		} else {
+			nargs++;
+		}
+	}
+
+	if (nargs != 11) {
+		usage();
 		return (1);
 	}
 
-	strcpy(path, argv[1]);
-	strcpy(template_path, argv[2]);
-	strcpy(patient_name, argv[3]);
-	strcpy(recording, argv[4]);
-	strcpy(outputfilename, argv[11]);
-	year = atoi(argv[5]);
-	month = atoi(argv[6]);
-	day = atoi(argv[7]);
-	hour = atoi(argv[8]);
-	minute = atoi(argv[9]);
-	second = atoi(argv[10]);
-	if (year < 0 || year > 99 || month < 1 || month > 12 || day < 1 || day > 31
-			|| hour < 0 || hour > 23 || minute < 0 || minute > 59 || second < 0
-			|| second > 59) {
+	if (job->nsinks > 1 && (job->split_seconds > 0 || job->split_bytes > 0)) {
+		printf("--also can not be combined with --split-duration or --split-size");
+		return 1;
+	}
+
+	if ((job->from > 0 || job->to >= 0)
+			&& (job->split_seconds > 0 || job->split_bytes > 0)) {
+		printf("--from and --to can not be combined with --split-duration or --split-size");
+		return 1;
+	}
+
+	if (job->physmax_fallback && job->physmax_percentile > 0.0) {
+		printf("--physmax-fallback can not be combined with --physmax-percentile");
+		return 1;
+	}
+
+	if (job->resume && job->checkpoint_seconds == 0) {
+		job->checkpoint_seconds = CHECKPOINT_INTERVAL;
+	}
+	if (job->checkpoint_seconds > 0
+			&& (job->split_seconds > 0 || job->split_bytes > 0)) {
+		printf("--checkpoint and --resume can not be combined with --split-duration or --split-size");
+		return 1;
+	}
+
+	snprintf(job->path, MAX_PATH_LENGTH, "%s", args[0]);
+	snprintf(job->template_path, MAX_PATH_LENGTH, "%s", args[1]);
+	snprintf(job->patient_name, 128, "%s", args[2]);
+	snprintf(job->recording, 128, "%s", args[3]);
+	snprintf(job->outputfilename, MAX_PATH_LENGTH, "%s", args[10]);
+	job->year = atoi(args[4]);
+	job->month = atoi(args[5]);
+	job->day = atoi(args[6]);
+	job->hour = atoi(args[7]);
+	job->minute = atoi(args[8]);
+	job->second = atoi(args[9]);
+	if (job->year < 0 || job->year > 99 || job->month < 1 || job->month > 12
+			|| job->day < 1 || job->day > 31 || job->hour < 0 || job->hour > 23
+			|| job->minute < 0 || job->minute > 59 || job->second < 0
+			|| job->second > 59) {
 		printf("Invalid date/time specified.  All date/time fields must be 2 digits");
 		return 1;
 	}
-	initSignalTable();
 
-	if (!strcmp(path, "")) {
-		printf("Path is null");
+	return 0;
+}
+
+/*
+ * Runs one conversion.  --stats output goes to stats_out, or with
+ * force_stats always as JSON.
+ */
+static int run(int argc, char *argv[], FILE *stats_out, int force_stats) {
+	int result;
+	char *progress_socket = NULL;
+	struct conv_job job;
+	struct conv_stats stats;
+	struct conv_progress progress;
+
+	if (parse_args(argc, argv, &job, &stats, &progress, &progress_socket)) {
 		return 1;
 	}
+	job.stats_out = stats_out;
+	if (force_stats) {
+		stats.mode = STATS_JSON;
+	}
 
-	inputfile = fopen(path, "rb");
-	if (inputfile == NULL ) {
-		printf("Failed to open infile for reading");
+	if (progress_socket != NULL
+			&& progress_open_socket(&progress, progress_socket)) {
+		printf("Can not connect to progress socket %s", progress_socket);
 		return 1;
 	}
 
-	if (!loadTemplate(template_path)) {
-		return (1);
+	if (progress_start(&progress)) {
+		printf("Can not start progress reporting");
+		return 1;
+	}
+
+	result = convert(&job, &stats, &progress);
+
+	progress_finish(&progress, result ? "error" : "done");
+
+	return result;
+}
+
+/* Runs a job of the daemon, replying with its statistics */
+static int run_job(int argc, char *argv[], FILE *result) {
+	int i, status;
+	char *text = NULL;
+	size_t len = 0;
+	FILE *stats_out;
+
+	/* descriptors of the daemon are not the client's to write to */
+	for (i = 0; i < argc; i++) {
+		if (!strncmp(argv[i], "--progress-fd=", 14)
+				|| !strncmp(argv[i], "--progress-socket=", 18)) {
+			printf("%.*s is not taken by daemon jobs", (int) (strchr(argv[i],
+					'=') - argv[i]), argv[i]);
+			return 1;
+		}
+	}
+
+	stats_out = open_memstream(&text, &len);
+	if (stats_out == NULL) {
+		return 1;
+	}
+
+	status = run(argc, argv, stats_out, 1);
+
+	fclose(stats_out);
+	while (len > 0 && (text[len - 1] == '\n' || text[len - 1] == ' ')) {
+		text[--len] = 0;
+	}
+	if (len > 0) {
+		fprintf(result, ",\"stats\":%s", text);
+	}
+	free(text);
+
+	return status;
+}
+
+int main(int argc, char *argv[]) {
+	int i, max_jobs = 0;
+	const char *daemon_path = NULL;
+
+	for (i = 1; i < argc; i++) {
+		if (!strncmp(argv[i], "--daemon=", 9)) {
+			daemon_path = argv[i] + 9;
+		} else if (!strncmp(argv[i], "--max-jobs=", 11)) {
+			max_jobs = atoi(argv[i] + 11);
+			if (max_jobs < 1) {
+				printf("Invalid number of jobs");
+				return 1;
+			}
+		}
+	}
+
+	if (daemon_path == NULL) {
+		return run(argc - 1, argv + 1, stderr, 0);
+	}
+
+	if (argc != (max_jobs ? 3 : 2)) {
+		printf("--daemon only takes --max-jobs\n");
+		return 1;
+	}
+
+	if (max_jobs == 0) {
+		max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+		if (max_jobs < 1) {
+			max_jobs = 1;
+		}
+	}
+
+	template_cache = (struct cached_template *) calloc(TEMPLATE_CACHE_SIZE,
+			sizeof(struct cached_template));
+	if (template_cache == NULL) {
+		printf("Critical error: Malloc error (template cache)");
+		return 1;
+	}
+
+	return daemon_run(daemon_path, max_jobs, run_job);
+}
+
+/********************** input file *************************/
+
+/* Opens the csv file, or the rows of the NumPy array */
+static FILE *open_input(const struct conv_job *job) {
+	if (job->npy.type != BINARY_NONE) {
+		return npy_open(job->path, &job->npy);
+	}
+	return io_open(job->path, "rb", job->io);
+}
+
+/* Bytes of the input file up to the end of its rows, -1 on errors */
+static long long input_size(const struct conv_job *job) {
+	struct stat st;
+
+	if (job->npy.type != BINARY_NONE) {
+		return job->npy.end;
+	}
+	return stat(job->path, &st) ? -1 : st.st_size;
+}
+
+/*
+ * Makes tpl read the rows of the NumPy array: its binary element is that of
+ * the array, whose channels are the columns.
+ */
+static int npy_template(const struct conv_job *job, const char *template_path,
+		struct conv_template *tpl) {
+	if (job->npy.columns != tpl->columns) {
+		printf("Error: %s has %d channels, template %s %d columns.",
+				job->path, job->npy.columns, template_path, tpl->columns);
+		return 1;
+	}
+	tpl->binary = job->npy.type;
+	tpl->big_endian = job->npy.big_endian;
+	tpl->header_bytes = (int) job->npy.offset;
+	return 0;
+}
+
+/********************** check file *************************/
+
+/*
+ * Skips the header lines and checks the number of columns in the first line
+ * of data.  The offset of the first line of data is stored in headersize.
+ */
+static int check_file(FILE *inputfile, const struct conv_template *tpl,
+		int *headersize) {
+	int i, column, column_end, temp, quoted = 0;
+
+	if (tpl->binary) {
+		*headersize = tpl->header_bytes;
+		if (fseek(inputfile, (long long) *headersize
+				+ binary_row_size(tpl) - 1, SEEK_SET)
+				|| fgetc(inputfile) == EOF) {
+			printf("File does not contain a whole row");
+			return 1;
+		}
+		return 0;
 	}
 
-	/********************** check file *************************/
 	rewind(inputfile);
 	temp = 0;
 
-	for (i = 0; i < (startline - 1);) {
+	for (i = 0; i < (tpl->startline - 1);) {
 		temp = fgetc(inputfile);
 
 		if (temp == EOF) {
@@ -163,7 +659,7 @@ int main(int argc, char *argv[]) {
 			i++;
 		}
 	}
-	headersize = ftell(inputfile);
+	*headersize = ftell(inputfile);
 	column_end = 1;
 	column = 0;
 
@@ -179,7 +675,12 @@ int main(int argc, char *argv[]) {
 			continue;
 		}
 
-		if (temp == separator) {
+		/* separators in double quotes are part of the field */
+		if (temp == '"') {
+			quoted = !quoted;
+		}
+
+		if (temp == tpl->separator && !quoted) {
 			if (!column_end) {
 				column++;
 				column_end = 1;
@@ -190,8 +691,8 @@ int main(int argc, char *argv[]) {
 					column++;
 				}
 
-				if (column != columns) {
-					printf("Number of columns (%d) does not match (%d)", column, columns);
+				if (column != tpl->columns) {
+					printf("Number of columns (%d) does not match (%d)", column, tpl->columns);
 					return 1;
 				}
 
@@ -206,782 +707,1788 @@ int main(int argc, char *argv[]) {
 		return 1;
 	}
 
-	/***************** find highest physical maximums ***********************/
+	return 0;
+}
+
+/*
+ * Called after a line with the wrong number of columns.  Returns 1 if the
+ * file ends within the next 10 characters, in which case the line is a
+ * truncated last row and the error is ignored.
+ */
+static int truncated_end(FILE *inputfile) {
+	int i;
+
+	for (i = 0; i < 10; i++) {
+		if (fgetc(inputfile) == EOF) {
+			break; /* ignore error because we reached the end of the file */
+		} /* added this code because some ascii-files stop abruptly in */
+	} /* the middle of a row but they do put a newline-character at the end */
+
+	return i < 10;
+}
+
+/*
+ * Picks the row kernels from the start of the data.  Carriage returns other
+ * than before a newline need the LINES_CRLF kernels, which drop them; rows
+ * of one length get the fixed row kernels, and columns of integers are
+ * decoded as integers.  A file with double quotes there is tokenized with
+ * the quoted field kernels; in others, the rows with quotes further on are
+ * tokenized again that way by the row kernels.
+ */
+static void select_file_kernels(FILE *inputfile, struct conv_template *tpl,
+		int headersize) {
+	char block[65536];
+	size_t i, n;
+	int j;
+
+	/* binary samples are what they are, and integers are exact */
+	if (tpl->binary) {
+		for (j = 0; j < tpl->edfsignals; j++) {
+			tpl->integer[j] = tpl->binary == BINARY_INT16
+					|| tpl->binary == BINARY_INT32;
+		}
+		select_kernels(tpl, LINES_LF);
+		return;
+	}
+
+	fseek(inputfile, (long long) headersize, SEEK_SET);
+	n = fread(block, 1, sizeof(block), inputfile);
+	tpl->quoted = memchr(block, '"', n) != NULL;
+	integer_columns_detect(tpl, block, n);
+	for (i = 0; i + 1 < n; i++) {
+		if (block[i] == '\r' && block[i + 1] != '\n') {
+			select_kernels(tpl, LINES_CRLF);
+			return;
+		}
+	}
+
+	fixed_rows_detect(tpl, block, n);
+	select_kernels(tpl, LINES_LF);
+}
+
+/***************** find highest physical maximums ***********************/
+
+/*
+ * Replaces the maxima by the percentile of the absolute values given with
+ * --physmax-percentile, found by the sketches of the signals.
+ */
+static void percentile_maxima(const struct conv_job *job,
+		const struct quantile_sketch *sketches, int n, double *maxima) {
+	int j;
+	double q;
+
+	for (j = 0; j < n; j++) {
+		q = quantile_get(&sketches[j], job->physmax_percentile / 100.0);
+		maxima[j] = q > 0.00001 ? q : 0.00001;
+	}
+}
+
+/* Adds a row of samples to the maxima and, if not NULL, the sketches */
+static void physmax_add(const struct conv_template *tpl, const double *value,
+		double *maxima, struct quantile_sketch *sketches) {
+	physmax_update(value, tpl->edfsignals, maxima);
+	if (sketches != NULL) {
+		quantile_update(sketches, value, tpl->edfsignals);
+	}
+}
+
+/*
+ * Finds the maxima of the rows to convert.  With sketches, which are NULL
+ * without --physmax-percentile, the maxima are percentiles with headroom.
+ * With --decimate-to the rows go through the decimation filter as in the
+ * conversion, and the maxima are those of the filtered samples written,
+ * whose overshoot at steps would otherwise clip.
+ */
+static int scan_physmax(FILE *inputfile, const struct conv_template *tpl,
+		int headersize, const struct conv_job *job, double *maxima,
+		struct quantile_sketch *sketches, struct conv_progress *progress) {
+	int j, len, column, eof = 0, result = 0;
+	long long row, pos, lastpos, lastrow, last, center;
+	char line[MAX_LINE_LENGTH + 2];
+	double value[MAX_EDF_SIGNALS], filtered[MAX_EDF_SIGNALS];
+	struct decimator dec, *decp = NULL;
+
+	physmax_reset(maxima);
+	for (j = 0; sketches != NULL && j < tpl->edfsignals; j++) {
+		quantile_init(&sketches[j]);
+	}
 
-	if (autoPhysicalMaximum) {
-		for (i = 0; i < MAX_EDF_SIGNALS; i++) {
-			physmax[i] = 0.00001;
+	/* like convert_rows(), the filter needs rows past the end of the range */
+	last = job->end_row;
+	if (job->decimate > 1) {
+		if (decimator_init(&dec, job->decimate, tpl->edfsignals)) {
+			printf("Critical error: Malloc error (decimator)");
+			return 1;
 		}
+		decp = &dec;
+		if (last >= 0) {
+			last += dec.half;
+		}
+	}
 
-		fseek(inputfile, (long long) headersize, SEEK_SET);
+	fseek(inputfile, (long long) headersize + job->first_offset, SEEK_SET);
+	row = lastrow = job->first_row;
+	lastpos = headersize + job->first_offset;
 
-		i = 0;
-		column = 0;
-		column_end = 1;
-		str_start = 0;
-		edf_signal = 0;
-		line_nr = startline;
+	while (last < 0 || row < last) {
+		len = tpl->kernels.read_row(tpl, inputfile, line);
 
-		while (1) {
-			temp = fgetc(inputfile);
+		if (len == ROW_EOF) {
+			eof = 1;
+			break;
+		}
 
-			if (temp == EOF) {
+		if (len == ROW_TOO_LONG) {
+			printf("Error, line %lli is too long.\n", tpl->startline + row);
+			result = 1;
+			break;
+		}
+
+		column = tpl->kernels.parse_row(tpl, line, len, value);
+
+		if (column != tpl->columns) {
+			if (truncated_end(inputfile)) {
+				eof = 1;
 				break;
 			}
 
-			line[i] = temp;
+			printf("Error, number of columns in line %lli is wrong.\n",
+					tpl->startline + row);
+			result = 1;
+			break;
+		}
+
+		row++;
+
+		if (progress->fd >= 0 && !(row % PROGRESS_ROWS)) {
+			pos = ftell(inputfile);
+			progress_add(progress, row - lastrow, pos - lastpos, 0);
+			lastpos = pos;
+			lastrow = row;
+		}
+
+		if (decp == NULL) {
+			physmax_add(tpl, value, maxima, sketches);
+		} else if (decimator_push(decp, value, filtered)) {
+			center = job->first_row + dec.next_center - dec.factor;
+			if (center >= job->start_row
+					&& (job->end_row < 0 || center < job->end_row)) {
+				physmax_add(tpl, filtered, maxima, sketches);
+			}
+		}
+	}
+
+	if (decp != NULL) {
+		while (!result && (job->end_row < 0 || eof)
+				&& decimator_flush(decp, filtered)) {
+			center = job->first_row + dec.next_center - dec.factor;
+			if (center >= job->start_row
+					&& (job->end_row < 0 || center < job->end_row)) {
+				physmax_add(tpl, filtered, maxima, sketches);
+			}
+		}
+		decimator_free(decp);
+	}
+	if (result) {
+		return result;
+	}
+
+	if (sketches != NULL) {
+		percentile_maxima(job, sketches, tpl->edfsignals, maxima);
+		for (j = 0; j < tpl->edfsignals; j++) {
+			maxima[j] *= job->physmax_headroom;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Estimates the maxima from a number of blocks of the file, evenly spaced or
+ * at random (but reproducible) offsets.  Every block starts at the first
+ * line boundary after its offset.  Lines which do not parse are skipped.
+ * With sketches the estimates are percentiles.  With --decimate-to every
+ * block goes through its own decimation filter, so the estimates are of the
+ * filtered samples.  Returns the number of bytes read, -1 on errors.
+ */
+static long long sample_physmax(FILE *inputfile,
+		const struct conv_template *tpl, long long base, long long datasize,
+		const struct conv_job *job, double *maxima,
+		struct quantile_sketch *sketches) {
+	int b, len, temp;
+	long long offset, start, bytes = 0;
+	unsigned int seed = (unsigned int) datasize;
+	char line[MAX_LINE_LENGTH + 2];
+	double value[MAX_EDF_SIGNALS], filtered[MAX_EDF_SIGNALS];
+	struct decimator dec;
+
+	physmax_reset(maxima);
+	for (b = 0; sketches != NULL && b < tpl->edfsignals; b++) {
+		quantile_init(&sketches[b]);
+	}
+
+	for (b = 0; b < job->physmax_samples; b++) {
+		if (job->physmax_random) {
+			seed = seed * 1103515245u + 12345u;
+			offset = (long long) ((double) (seed >> 1) / 2147483648.0
+					* (datasize - PHYSMAX_SAMPLE_BLOCK));
+		} else if (job->physmax_samples > 1) {
+			offset = (datasize - PHYSMAX_SAMPLE_BLOCK) * b
+					/ (job->physmax_samples - 1);
+		} else {
+			offset = 0;
+		}
 
-			if (line[i] == '\r') {
+		if (tpl->binary) {
+			fseek(inputfile, base + offset - offset % binary_row_size(tpl),
+					SEEK_SET);
+		} else if (offset > 0) {
+			fseek(inputfile, base + offset - 1, SEEK_SET);
+			do {
+				temp = fgetc(inputfile);
+			} while (temp != '\n' && temp != EOF);
+		} else {
+			fseek(inputfile, base, SEEK_SET);
+		}
+
+		if (job->decimate > 1
+				&& decimator_init(&dec, job->decimate, tpl->edfsignals)) {
+			printf("Critical error: Malloc error (decimator)");
+			return -1;
+		}
+
+		start = ftell(inputfile);
+		while (ftell(inputfile) - start < PHYSMAX_SAMPLE_BLOCK) {
+			len = tpl->kernels.read_row(tpl, inputfile, line);
+
+			if (len == ROW_EOF) {
+				break;
+			}
+
+			if (len == ROW_TOO_LONG) {
 				continue;
 			}
 
-			if (separator != ',') {
-				if (line[i] == ',') {
-					line[i] = '.';
-				}
+			if (tpl->kernels.parse_row(tpl, line, len, value)
+					!= tpl->columns) {
+				continue;
+			}
+			if (job->decimate <= 1) {
+				physmax_add(tpl, value, maxima, sketches);
+			} else if (decimator_push(&dec, value, filtered)) {
+				physmax_add(tpl, filtered, maxima, sketches);
 			}
+		}
+		bytes += ftell(inputfile) - start;
 
-			if (line[i] == separator) {
-				if (!column_end) {
-					if (column_enabled[column]) {
-						value[edf_signal] = atof(line + str_start);
-						edf_signal++;
-					}
-					column_end = 1;
-					column++;
-				}
-			} else {
-				if (line[i] != '\n') {
-					if (column_end) {
-						str_start = i;
-						column_end = 0;
-					}
-				}
+		if (job->decimate > 1) {
+			while (decimator_flush(&dec, filtered)) {
+				physmax_add(tpl, filtered, maxima, sketches);
 			}
+			decimator_free(&dec);
+		}
+	}
 
-			if (line[i] == '\n') {
-				if (!column_end) {
-					if (column_enabled[column]) {
-						value[edf_signal] = atof(line + str_start);
+	if (sketches != NULL) {
+		percentile_maxima(job, sketches, tpl->edfsignals, maxima);
+	}
 
-						edf_signal++;
-					}
-					column++;
-					column_end = 1;
-				}
+	for (b = 0; b < tpl->edfsignals; b++) {
+		maxima[b] *= job->physmax_headroom;
+	}
+
+	return bytes;
+}
+
+/***************** conversion *******************************************/
+
+/*
+ * One EDF file to write: the whole recording, or one segment of it.  Rows
+ * are counted from the first line of data.  Rows from first up to start
+ * only warm up the decimation filter.
+ */
+struct edf_output {
+	char filename[MAX_PATH_LENGTH];
+	long long offset; /* byte offset of row first, headersize excluded */
+	long long first;
+	long long start;
+	long long end; /* one past the last row, -1 for the end of the file */
+	long long seconds; /* start time relative to the recording */
+};
+
+struct record_writer {
+	const struct conv_template *tpl;
+	const int *src; /* value of every signal, NULL if in order */
+	struct record_writer *next; /* next output of the same rows */
+	FILE *outputfile;
+	char *buf;
+	int bufsize;
+	int smpls_per_block;
+	int k; /* samples in the current datarecord */
+	int datarecords;
+	long long *clips;
+	struct signal_stats *sigstats; /* NULL if not kept */
+	struct output_hash *hash; /* of the datarecords, NULL if not kept */
+};
+
+/*
+ * Adds one sample per signal to the current datarecord of every writer and
+ * writes the datarecords that are full.
+ */
+static int put_row(struct record_writer *w, const double *value) {
+	int j;
+	double gathered[MAX_EDF_SIGNALS];
+	const double *v;
+
+	for (; w != NULL; w = w->next) {
+		v = value;
+		if (w->src != NULL) {
+			for (j = 0; j < w->tpl->edfsignals; j++) {
+				gathered[j] = value[w->src[j]];
+			}
+			v = gathered;
+		}
+
+		w->tpl->kernels.quantize_row(w->tpl, v, w->buf, w->k,
+				w->smpls_per_block, w->clips);
+		w->k++;
+		if (w->sigstats != NULL) {
+			sigstats_add(w->sigstats, v);
+		}
+
+		if (w->k >= w->smpls_per_block) {
+			if (fwrite(w->buf, w->bufsize, 1, w->outputfile) != 1) {
+				printf("Error: Write error during conversion.");
+				return 1;
+			}
+			if (w->hash != NULL) {
+				hash_update(w->hash, w->buf, w->bufsize);
+			}
+			w->datarecords++;
+			w->k = 0;
+			if (w->sigstats != NULL) {
+				sigstats_flush(w->sigstats);
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* Saves the state after row, the next row starting at offset */
+static int save_checkpoint(struct checkpoint *ck,
+		const struct record_writer *w, long long offset, long long row) {
+	int i;
+
+	ck->offset = offset;
+	ck->row = row;
+	for (i = 0; w != NULL; w = w->next, i++) {
+		ck->outputs[i].datarecords = w->datarecords;
+		ck->outputs[i].k = w->k;
+	}
+
+	return checkpoint_write(ck);
+}
+
+static int convert_rows(FILE *inputfile, const struct conv_template *tpl,
+		int headersize, const struct edf_output *out, struct record_writer *w,
+		struct decimator *dec, struct checkpoint *ck, struct conv_stats *stats,
+		struct conv_progress *progress) {
+	int len, column, lastrecords = 0, eof = 0;
+	long long row, center, last, pos, lastpos, lastrow, base;
+	time_t due = 0;
+	char line[MAX_LINE_LENGTH + 2];
+	double value[MAX_EDF_SIGNALS], filtered[MAX_EDF_SIGNALS];
+
+	/* the decimation filter needs rows past the end of the segment */
+	last = out->end;
+	if (last >= 0 && dec != NULL) {
+		last += dec->half;
+	}
+
+	/* the row the decimator started at, before a resumed checkpoint */
+	base = out->first - (dec != NULL ? dec->inputs : 0);
+
+	if (ck != NULL) {
+		due = time(NULL) + ck->interval;
+	}
+
+	fseek(inputfile, (long long) headersize + out->offset, SEEK_SET);
+	row = lastrow = out->first;
+	lastpos = headersize + out->offset;
+
+	while (last < 0 || row < last) {
+		len = tpl->kernels.read_row(tpl, inputfile, line);
+
+		if (len == ROW_EOF) {
+			eof = 1;
+			break;
+		}
+
+		if (len == ROW_TOO_LONG) {
+			printf("Error, line %lli is too long.\n", tpl->startline + row);
+			return 1;
+		}
+
+		column = tpl->kernels.parse_row(tpl, line, len, value);
 
-				if (column != columns) {
-					for (j = 0; j < 10; j++) {
-						if (fgetc(inputfile) == EOF) {
-							break; /* ignore error because we reached the end of the file */
-						} /* added this code because some ascii-files stop abruptly in */
-					} /* the middle of a row but they do put a newline-character at the end */
+		if (column != tpl->columns) {
+			if (truncated_end(inputfile)) {
+				eof = 1;
+				break;
+			}
+
+			printf("Error, number of columns in line %lli is wrong.\n",
+					tpl->startline + row);
+			return 1;
+		}
+
+		row++;
 
-					if (j < 10) {
-						break;
-					}
+		if (progress->fd >= 0 && !(row % PROGRESS_ROWS)) {
+			pos = ftell(inputfile);
+			progress_add(progress, row - lastrow, pos - lastpos,
+					w->datarecords - lastrecords);
+			lastpos = pos;
+			lastrow = row;
+			lastrecords = w->datarecords;
+		}
 
-					printf("Error, number of columns in line %i is wrong.\n",
-							line_nr);
-					fclose(inputfile);
+		if (dec == NULL) {
+			if (put_row(w, value)) {
+				return 1;
+			}
+		} else if (decimator_push(dec, value, filtered)) {
+			center = base + dec->next_center - dec->factor;
+			if (center >= out->start && (out->end < 0 || center < out->end)) {
+				if (put_row(w, filtered)) {
 					return 1;
 				}
+			}
+		}
 
-				line_nr++;
-
-				for (j = 0; j < edfsignals; j++) {
-					if (value[j] < 0.0) {
-						value[j] *= -1.0;
-					}
+		if (ck != NULL && !(row % PROGRESS_ROWS) && time(NULL) >= due) {
+			if (save_checkpoint(ck, w, ftell(inputfile) - headersize, row)) {
+				return 1;
+			}
+			due = time(NULL) + ck->interval;
+		}
+	}
 
-					if (physmax[j] < value[j]) {
-						physmax[j] = value[j];
-					}
+	if (dec != NULL && (out->end < 0 || eof)) {
+		while (decimator_flush(dec, filtered)) {
+			center = base + dec->next_center - dec->factor;
+			if (center >= out->start && (out->end < 0 || center < out->end)) {
+				if (put_row(w, filtered)) {
+					return 1;
 				}
+			}
+		}
+	}
 
-				str_start = 0;
-				i = 0;
-				column = 0;
-				column_end = 1;
-				edf_signal = 0;
+	pos = ftell(inputfile);
+	progress_add(progress, row - lastrow, pos - lastpos,
+			w->datarecords - lastrecords);
+	stats->bytes_read += pos - headersize - out->offset;
+	stats->rows += row - out->first;
+
+	return 0;
+}
+
+/*
+ * Advances the start date and time of a header by a number of seconds.
+ * Two digit years follow the EDF convention, 85-99 are 1985-1999.
+ */
+static void advance_start(struct edf_header *hdr, long long seconds) {
+	struct tm tm;
+	time_t t;
+
+	memset(&tm, 0, sizeof(tm));
+	tm.tm_year = hdr->year < 85 ? hdr->year + 100 : hdr->year;
+	tm.tm_mon = hdr->month - 1;
+	tm.tm_mday = hdr->day;
+	tm.tm_hour = hdr->hour;
+	tm.tm_min = hdr->minute;
+	tm.tm_sec = hdr->second;
+
+	t = timegm(&tm) + seconds;
+	gmtime_r(&t, &tm);
+
+	hdr->year = tm.tm_year % 100;
+	hdr->month = tm.tm_mon + 1;
+	hdr->day = tm.tm_mday;
+	hdr->hour = tm.tm_hour;
+	hdr->minute = tm.tm_min;
+	hdr->second = tm.tm_sec;
+}
+
+/* <output>.ckpt, next to the (first) output file */
+static void checkpoint_path(const struct conv_job *job, char *path) {
+	snprintf(path, MAX_PATH_LENGTH, "%s.ckpt", job->outputfilename);
+}
+
+/* <output>.stats.json, next to an output file */
+static void sigstats_path(const char *output, char *path) {
+	snprintf(path, MAX_PATH_LENGTH, "%s.stats.json", output);
+}
+
+/*
+ * Sets up the checkpoints of a conversion and, when resuming, restores the
+ * writers, the decimator and the physical maxima from the last one.
+ */
+static int start_checkpoints(const struct conv_job *job,
+		struct checkpoint *ck, struct checkpoint_output *outputs,
+		struct record_writer *w, struct decimator *dec) {
+	int i;
+	struct stat st;
+	struct conv_template *tpl;
+
+	memset(ck, 0, sizeof(struct checkpoint));
+	checkpoint_path(job, ck->path);
+	ck->interval = job->checkpoint_seconds;
+	ck->smpls_per_block = job->smpls_per_block;
+	ck->decimate = job->decimate;
+	ck->noutputs = job->nsinks;
+	ck->outputs = outputs;
+	ck->dec = dec;
+
+	if (stat(job->path, &st)) {
+		printf("Can not stat %s", job->path);
+		return 1;
+	}
+	ck->input_size = st.st_size;
+	ck->input_mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+
+	memset(outputs, 0, sizeof(struct checkpoint_output) * job->nsinks);
+	for (i = 0; i < job->nsinks; i++) {
+		tpl = &job->sinks[i].tpl;
+		outputs[i].filename = job->sinks[i].outputfilename;
+		outputs[i].bufsize = w[i].bufsize;
+		outputs[i].buf = w[i].buf;
+		outputs[i].nsignals = tpl->edfsignals;
+		outputs[i].sigphysmax = tpl->sigphysmax;
+		outputs[i].sensitivity = tpl->sensitivity;
+		outputs[i].clips = w[i].clips;
+		outputs[i].sigstats = w[i].sigstats;
+		outputs[i].hash = w[i].hash;
+	}
+
+	if (!job->resuming) {
+		return 0;
+	}
+
+	if (checkpoint_read(ck)) {
+		return 1;
+	}
+
+	for (i = 0; i < job->nsinks; i++) {
+		w[i].datarecords = outputs[i].datarecords;
+		w[i].k = outputs[i].k;
+
+		/* drop what was written after the checkpoint */
+		if (stat(outputs[i].filename, &st) || st.st_size < outputs[i].size) {
+			printf("Error: %s is shorter than its checkpoint",
+					outputs[i].filename);
+			return 1;
+		}
+		if (truncate(outputs[i].filename, outputs[i].size)) {
+			printf("Error: Can not truncate %s", outputs[i].filename);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Writes the header and the datarecords of the output files, one for every
+ * sink.  tpl is the template the rows are parsed with.  With --signal-stats
+ * the statistics of the first output are added to totals unless it is NULL.
+ */
+static int write_edf(const struct conv_job *job,
+		const struct conv_template *tpl, FILE *inputfile, int headersize,
+		const struct edf_output *out, struct conv_stats *stats,
+		struct conv_progress *progress, struct signal_stats *totals) {
+	int i, j, n = job->nsinks, result = 0, decimating = 0, checkpoints = 0;
+	const char *filename;
+	char path[MAX_PATH_LENGTH];
+	struct edf_header hdr;
+	struct record_writer w[MAX_OUTPUTS];
+	struct decimator dec;
+	struct checkpoint ck;
+	struct checkpoint_output ck_outputs[MAX_OUTPUTS];
+	struct edf_output from = *out;
+
+	/*outputfilename[0] = 0; */
+	if (!strcmp(out->filename, "")) {
+		return 1;
+	}
+
+	memset(w, 0, sizeof(struct record_writer) * n);
+	for (i = 0; i < n && !result; i++) {
+		w[i].tpl = &job->sinks[i].tpl;
+		w[i].src = n > 1 ? job->sinks[i].src : NULL;
+		w[i].next = i + 1 < n ? &w[i + 1] : NULL;
+		w[i].smpls_per_block = job->smpls_per_block;
+		w[i].bufsize = datarecord_size(w[i].tpl, job->smpls_per_block);
+		w[i].clips = i ? job->sinks[i].clips : stats->clips;
+
+		w[i].buf = (char *) calloc(1, w[i].bufsize);
+		if (w[i].buf == NULL ) {
+			printf("Critical error: Malloc error (buf)");
+			result = 1;
+		}
+
+		if (job->signal_stats && !result) {
+			w[i].sigstats = (struct signal_stats *) malloc(
+					sizeof(struct signal_stats));
+			if (w[i].sigstats == NULL) {
+				printf("Critical error: Malloc error (signal stats)");
+				result = 1;
 				continue;
 			}
+			sigstats_init(w[i].sigstats, w[i].tpl->edfsignals);
+			/* clips counts go on across segments, only the growth is ours */
+			for (j = 0; j < w[i].tpl->edfsignals; j++) {
+				w[i].sigstats->saturated[j] = -w[i].clips[j];
+			}
+		}
 
-			i++;
+		if (job->hash && !result) {
+			w[i].hash = (struct output_hash *) malloc(
+					sizeof(struct output_hash));
+			if (w[i].hash == NULL) {
+				printf("Critical error: Malloc error (hash)");
+				result = 1;
+				continue;
+			}
+			hash_init(w[i].hash, job->hash);
+		}
+	}
 
-			if (i > 2046) {
-				printf("Error, line %i is too long.\n", line_nr);
-				fclose(inputfile);
-				return 1;
+	if (!result && job->decimate > 1) {
+		if (decimator_init(&dec, job->decimate, tpl->edfsignals)) {
+			printf("Critical error: Malloc error (decimator)");
+			result = 1;
+		} else {
+			decimating = 1;
+		}
+	}
+
+	if (!result && job->checkpoint_seconds > 0) {
+		result = start_checkpoints(job, &ck, ck_outputs, w,
+				decimating ? &dec : NULL);
+		checkpoints = !result;
+		if (checkpoints && job->resuming) {
+			for (i = 0; i < n; i++) {
+				exact_scaling(&job->sinks[i].tpl);
 			}
+			/* start stays, decimated rows lag the input */
+			from.offset = ck.offset;
+			from.first = ck.row;
+			progress_add(progress, ck.row, ck.offset, w[0].datarecords);
 		}
-		edf_signal = 0;
+	}
 
-		for (i = 0; i < columns; i++) {
-			if (column_enabled[i]) {
-				physmax[edf_signal] *= multiplier[i];
+	/***************** write header *****************************************/
 
-				if (physmax[edf_signal] > 9999999.0) {
-					physmax[edf_signal] = 9999999.0;
-				}
+	stats_begin(stats);
+
+	hdr.patient_name = job->patient_name;
+	hdr.recording = job->recording;
+	hdr.day = job->day;
+	hdr.month = job->month;
+	hdr.year = job->year;
+	hdr.hour = job->hour;
+	hdr.minute = job->minute;
+	hdr.second = job->second;
+	hdr.smpls_per_block = job->smpls_per_block;
+	hdr.datrecduration = job->datrecduration;
+	advance_start(&hdr, out->seconds);
+
+	for (i = 0; i < n && !result; i++) {
+		filename = i ? job->sinks[i].outputfilename : out->filename;
+		if (job->resuming) {
+			/* the header and the datarecords so far are in place */
+			w[i].outputfile = io_open(filename, "r+b", job->io);
+			if (w[i].outputfile == NULL
+					|| fseek(w[i].outputfile, 0, SEEK_END)) {
+				printf("Can not open file %s for writing.", filename);
+				result = 1;
+			}
+		} else {
+			w[i].outputfile = io_open(filename, "wb", job->io);
+			if (w[i].outputfile == NULL ) {
+				printf("Can not open file %s for writing.", filename);
+				result = 1;
+			} else if (write_header(w[i].outputfile, &job->sinks[i].tpl,
+					&hdr)) {
+				printf("Error: A write error occurred.");
+				result = 1;
+			}
+		}
+		ck_outputs[i].file = w[i].outputfile;
+	}
 
-				if (edf_format) {
-					sensitivity[edf_signal] = 32767.0 / physmax[edf_signal];
-				} else {
-					sensitivity[edf_signal] = 8388607.0 / physmax[edf_signal];
-				}
+	stats_end(stats, PHASE_HEADER);
+
+	/***************** start conversion **************************************/
+
+	stats_begin(stats);
 
-				sensitivity[edf_signal++] *= multiplier[i];
+	if (!result) {
+		result = convert_rows(inputfile, tpl, headersize, &from, w,
+				decimating ? &dec : NULL, checkpoints ? &ck : NULL, stats,
+				progress);
+	}
+
+	if (decimating) {
+		decimator_free(&dec);
+	}
+
+	for (i = 0; i < n; i++) {
+		free(w[i].buf);
+		if (w[i].outputfile == NULL) {
+			free(w[i].sigstats);
+			free(w[i].hash);
+			continue;
+		}
+
+		if (!result) {
+			stats->bytes_written += ftell(w[i].outputfile);
+			fseek(w[i].outputfile, 236LL, SEEK_SET);
+			fprintf(w[i].outputfile, "%-8i", w[i].datarecords);
+		}
+
+		if (fclose(w[i].outputfile) && !result) {
+			printf("Error: An error occurred when closing outputfile.");
+			result = 1;
+		}
+
+		/* the header goes last, with its number of datarecords */
+		if (w[i].hash != NULL && !result) {
+			result = hash_file(w[i].hash,
+					i ? job->sinks[i].outputfilename : out->filename);
+		}
+		free(w[i].hash);
+	}
+
+	for (i = 0; i < n; i++) {
+		if (w[i].sigstats == NULL) {
+			continue;
+		}
+		if (!result) {
+			for (j = 0; j < w[i].tpl->edfsignals; j++) {
+				w[i].sigstats->saturated[j] += w[i].clips[j];
+			}
+			filename = i ? job->sinks[i].outputfilename : out->filename;
+			sigstats_path(filename, path);
+			result = sigstats_write(path, filename, w[i].sigstats, w[i].tpl);
+			if (!i && totals != NULL) {
+				sigstats_merge(totals, w[i].sigstats);
 			}
 		}
+		free(w[i].sigstats);
+	}
+
+	if (result) {
+		return 1;
+	}
+
+	/* the outputs are complete, the checkpoint is of no use any more */
+	if (checkpoints) {
+		unlink(ck.path);
+	}
+
+	stats->datarecords += w[0].datarecords;
+
+	stats_end(stats, PHASE_CONVERT);
+
+	return 0;
+}
+
+/***************** split output *****************************************/
+
+struct split_plan {
+	const struct conv_job *job;
+	const struct conv_template *tpl;
+	int headersize;
+	struct edf_output *segments;
+	int nsegments;
+	int next; /* next segment to be taken by a worker */
+	int error;
+	struct conv_stats *stats;
+	struct conv_progress *progress;
+	struct signal_stats sigstats; /* of all segments, with --signal-stats */
+	FILE *output; /* stdout of the daemon job, NULL outside the daemon */
+	pthread_mutex_t lock;
+};
+
+/*
+ * Number of datarecords in a segment.  Segments are kept to whole seconds
+ * where the datarecord duration allows it, so every segment starts at a
+ * time the header can express.
+ */
+static long long segment_records(const struct conv_job *job,
+		const struct conv_template *tpl) {
+	long long records, step = 1, bufsize;
+
+	while (step < 1000 && fabs(step * job->datrecduration
+			- floor(step * job->datrecduration + 0.5)) > 1e-9) {
+		step++;
+	}
+	if (step == 1000) {
+		step = 1;
+	}
+
+	if (job->split_seconds > 0) {
+		records = (long long) (job->split_seconds / job->datrecduration + 0.5);
+	} else {
+		bufsize = datarecord_size(tpl, job->smpls_per_block);
+		records = (job->split_bytes - (256LL * tpl->edfsignals + 256))
+				/ bufsize;
+	}
+
+	records -= records % step;
+	if (records < step) {
+		records = step;
+	}
+
+	return records;
+}
+
+/* The name of segment n, <output>_<n + 1><extension of output> */
+static void segment_filename(const char *output, int n, char *filename) {
+	const char *dot = strrchr(output, '.'), *slash = strrchr(output, '/');
+
+	if (dot == NULL || (slash != NULL && dot < slash)) {
+		dot = output + strlen(output);
+	}
+	snprintf(filename, MAX_PATH_LENGTH, "%.*s_%03d%s", (int) (dot - output),
+			output, n + 1, dot);
+}
+
+/*
+ * Finds the rows at which the segments start through the row index and
+ * fills in the segments.  Every segment but the last holds rows_per_segment
+ * rows; lead rows before each segment are read to warm up the decimation
+ * filter.
+ */
+static int plan_segments(FILE *inputfile, const struct conv_job *job,
+		long long rows_per_segment, long long lead, double seconds_per_segment,
+		struct edf_output **segments, int *nsegments) {
+	size_t n;
+	long long rows = job->row_index->rows;
+	int count;
+	struct edf_output *seg;
+
+	/* leave out segments too short for a single datarecord */
+	for (count = 1; count * rows_per_segment
+			+ (long long) job->smpls_per_block * job->decimate <= rows;
+			count++)
+		;
+
+	seg = (struct edf_output *) calloc(count, sizeof(struct edf_output));
+	if (seg == NULL) {
+		printf("Critical error: Malloc error (split)");
+		return 1;
+	}
+
+	for (n = 0; n < (size_t) count; n++) {
+		seg[n].start = rows_per_segment * n;
+		seg[n].first = seg[n].start - lead < 0 ? 0 : seg[n].start - lead;
+		seg[n].offset = rowindex_seek(inputfile, job->row_index, seg[n].first);
+		seg[n].end = seg[n].start + rows_per_segment;
+		seg[n].seconds = (long long) (seconds_per_segment * n + 0.5);
+		if (seg[n].offset < 0) {
+			printf("Error: Row index of %s is out of date", job->path);
+			free(seg);
+			return 1;
+		}
+	}
+	/* the last one runs to the end of the file */
+	seg[count - 1].end = -1;
+
+	for (n = 0; n < (size_t) count; n++) {
+		segment_filename(job->outputfilename, (int) n, seg[n].filename);
+	}
+
+	*segments = seg;
+	*nsegments = count;
+	return 0;
+}
+
+static void *split_worker(void *arg) {
+	struct split_plan *plan = (struct split_plan *) arg;
+	struct conv_stats stats;
+	struct signal_stats sigstats;
+	FILE *inputfile;
+	int i, s;
+
+	daemon_set_job_output(plan->output);
+	inputfile = open_input(plan->job);
+	if (inputfile == NULL) {
+		printf("Failed to open infile for reading");
+		__atomic_store_n(&plan->error, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	stats_init(&stats, STATS_OFF);
+	sigstats_init(&sigstats, plan->sigstats.nsignals);
+
+	while (!__atomic_load_n(&plan->error, __ATOMIC_RELAXED)) {
+		s = __atomic_fetch_add(&plan->next, 1, __ATOMIC_RELAXED);
+		if (s >= plan->nsegments) {
+			break;
+		}
+
+		if (write_edf(plan->job, plan->tpl, inputfile, plan->headersize,
+				&plan->segments[s], &stats, plan->progress,
+				plan->job->signal_stats ? &sigstats : NULL)) {
+			__atomic_store_n(&plan->error, 1, __ATOMIC_RELAXED);
+		}
+	}
+	fclose(inputfile);
+
+	pthread_mutex_lock(&plan->lock);
+	plan->stats->bytes_read += stats.bytes_read;
+	plan->stats->bytes_written += stats.bytes_written;
+	plan->stats->rows += stats.rows;
+	plan->stats->datarecords += stats.datarecords;
+	for (i = 0; i < MAX_EDF_SIGNALS; i++) {
+		plan->stats->clips[i] += stats.clips[i];
+	}
+	sigstats_merge(&plan->sigstats, &sigstats);
+	pthread_mutex_unlock(&plan->lock);
+
+	return NULL;
+}
+
+/*
+ * Cuts the recording into segments of a fixed duration or size, each with
+ * its own header, written concurrently by job->workers threads.  The
+ * number of segments goes to *nsegments.
+ */
+static int write_split(const struct conv_job *job,
+		const struct conv_template *tpl, FILE *inputfile, int headersize,
+		struct conv_stats *stats, struct conv_progress *progress,
+		int *nsegments) {
+	long long records, rows_per_segment, lead;
+	int i, workers;
+	char path[MAX_PATH_LENGTH];
+	pthread_t *threads;
+	struct split_plan plan;
+
+	records = segment_records(job, tpl);
+	rows_per_segment = records * job->smpls_per_block * job->decimate;
+	lead = job->decimate > 1 ? DECIMATE_HALF_TAPS * job->decimate : 0;
+
+	memset(&plan, 0, sizeof(plan));
+	plan.job = job;
+	plan.tpl = tpl;
+	plan.headersize = headersize;
+	plan.stats = stats;
+	plan.progress = progress;
+	plan.output = daemon_job_output();
+	sigstats_init(&plan.sigstats, job->sinks[0].tpl.edfsignals);
+
+	if (plan_segments(inputfile, job, rows_per_segment, lead,
+			records * job->datrecduration, &plan.segments, &plan.nsegments)) {
+		return 1;
+	}
+	*nsegments = plan.nsegments;
+
+	workers = job->workers < plan.nsegments ? job->workers : plan.nsegments;
+	threads = (pthread_t *) malloc(sizeof(pthread_t) * workers);
+	if (threads == NULL) {
+		printf("Critical error: Malloc error (split)");
+		free(plan.segments);
+		return 1;
+	}
+
+	stats_begin_threads(stats);
+	pthread_mutex_init(&plan.lock, NULL);
+	for (i = 0; i < workers; i++) {
+		if (pthread_create(&threads[i], NULL, split_worker, &plan)) {
+			plan.error = 1;
+			break;
+		}
+	}
+	workers = i;
+	for (i = 0; i < workers; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	pthread_mutex_destroy(&plan.lock);
+	stats_end(stats, PHASE_CONVERT);
+
+	free(threads);
+	free(plan.segments);
 
+	/* the whole recording, next to where it would have been written */
+	if (!plan.error && job->signal_stats) {
+		sigstats_path(job->outputfilename, path);
+		return sigstats_write(path, job->outputfilename, &plan.sigstats,
+				&job->sinks[0].tpl);
 	}
 
-	/***************** write header *****************************************/
+	return plan.error;
+}
 
-	/*outputfilename[0] = 0; */
-	if (!strcmp(outputfilename, "")) {
-		fclose(inputfile);
-		return 1;
+/*
+ * Writes the output, as one file or as segments.  *nsegments is the number
+ * of segments, 0 for a single file.
+ */
+static int write_output(const struct conv_job *job,
+		const struct conv_template *tpl, FILE *inputfile, int headersize,
+		struct conv_stats *stats, struct conv_progress *progress,
+		int *nsegments) {
+	struct edf_output out;
+
+	progress_phase(progress, "convert", progress->passes);
+
+	*nsegments = 0;
+	if (job->split_seconds > 0 || job->split_bytes > 0) {
+		return write_split(job, tpl, inputfile, headersize, stats, progress,
+				nsegments);
 	}
 
-	outputfile = fopen(outputfilename, "wb");
-	if (outputfile == NULL ) {
-		printf("Can not open file %s for writing.", outputfilename);
-		fclose(inputfile);
-		return 1;
-	}
+	memset(&out, 0, sizeof(out));
+	snprintf(out.filename, MAX_PATH_LENGTH, "%s", job->outputfilename);
+	out.offset = job->first_offset;
+	out.first = job->first_row;
+	out.start = job->start_row;
+	out.end = job->end_row;
+	out.seconds = job->start_seconds;
 
-	if (edf_format) {
-		fprintf(outputfile, "0       ");
-	} else {
-		fputc(255, outputfile);
-		fprintf(outputfile, "BIOSEMI");
-	}
-
-	p = snprintf(scratchpad, 128, "%s", patient_name);
-	for (; p < 80; p++) {
-		scratchpad[p] = ' ';
-	}
-	latin1_to_ascii(scratchpad, 80);
-	scratchpad[80] = 0;
-	fprintf(outputfile, "%s", scratchpad);
-
-	p = snprintf(scratchpad, 128, "%s", recording);
-	for (; p < 80; p++) {
-		scratchpad[p] = ' ';
-	}
-	latin1_to_ascii(scratchpad, 80);
-	scratchpad[80] = 0;
-	fprintf(outputfile, "%s", scratchpad);
-
-	fprintf(outputfile, "%02i.%02i.%02i%02i.%02i.%02i", day, month, year, hour,
-			minute, second);
-	fprintf(outputfile, "%-8i", 256 * edfsignals + 256);
-	fprintf(outputfile, "                                            ");
-	fprintf(outputfile, "-1      ");
-	if (samplefrequency < 1.0) {
-		datrecduration = 1.0 / samplefrequency;
-		snprintf(str, 256, "%.8f", datrecduration);
-		if (fwrite(str, 8, 1, outputfile) != 1) {
-			printf("Error: A write error occurred.");
-			fclose(inputfile);
-			fclose(outputfile);
+	return write_edf(job, tpl, inputfile, headersize, &out, stats, progress,
+			NULL);
+}
+
+/*
+ * Checks that the templates of all outputs describe the same rows and
+ * builds the template the rows are parsed with, which has every column
+ * any of them uses.  Fills in src of every sink.
+ */
+static int shared_columns(struct conv_job *job, struct conv_template *parse) {
+	int i, j, s, value;
+	const struct conv_template *first = &job->sinks[0].tpl, *tpl;
+
+	memcpy(parse, first, sizeof(struct conv_template));
+
+	for (s = 1; s < job->nsinks; s++) {
+		tpl = &job->sinks[s].tpl;
+		if (tpl->separator != first->separator
+				|| tpl->columns != first->columns
+				|| tpl->startline != first->startline
+				|| tpl->samplefrequency != first->samplefrequency
+				|| tpl->binary != first->binary
+				|| tpl->big_endian != first->big_endian
+				|| tpl->header_bytes != first->header_bytes) {
+			printf("Error: templates %s and %s describe different csv files.",
+					job->sinks[0].template_path, job->sinks[s].template_path);
 			return 1;
 		}
-	} else {
-		if (((int) samplefrequency) % 10) {
-			datrecduration = 1.0;
-			fprintf(outputfile, "1       ");
-		} else {
-			datrecduration = 0.1;
-			fprintf(outputfile, "0.1     ");
-		}
-	}
-	fprintf(outputfile, "%-4i", edfsignals);
 
-	for (i = 0; i < columns; i++) {
-		if (column_enabled[i]) {
-			p = fprintf(outputfile, "%s", signames[i]);
-			for (j = p; j < 16; j++) {
-				fputc(' ', outputfile);
-			}
+		for (i = 0; i < tpl->columns; i++) {
+			parse->column_enabled[i] |= tpl->column_enabled[i];
 		}
 	}
 
-	for (i = 0; i < (80 * edfsignals); i++) {
-		fputc(' ', outputfile);
-	}
-
-	for (i = 0; i < columns; i++) {
-		if (column_enabled[i]) {
-			p = fprintf(outputfile, "%s", sigdimensions[i]);
-			for (j = p; j < 8; j++) {
-				fputc(' ', outputfile);
+	parse->edfsignals = 0;
+	for (i = 0; i < parse->columns; i++) {
+		if (parse->column_enabled[i]) {
+			if (parse->edfsignals == MAX_EDF_SIGNALS) {
+				printf("Error Too many signals in these templates.");
+				return 1;
 			}
+			parse->sigcolumn[parse->edfsignals++] = i;
 		}
 	}
-	edf_signal = 0;
 
-	for (i = 0; i < columns; i++) {
-		if (column_enabled[i]) {
-			if (autoPhysicalMaximum) {
-				sprintf(str, "%.8f", physmax[edf_signal++] * -1.0);
-				strcat(str, "        ");
-				str[8] = 0;
-				fprintf(outputfile, "%s", str);
-			} else {
-				fputc('-', outputfile);
-				p = fprintf(outputfile, "%f", physmax[i]);
-				for (j = p; j < 7; j++) {
-					fputc(' ', outputfile);
+	for (s = 0; s < job->nsinks; s++) {
+		tpl = &job->sinks[s].tpl;
+		for (i = 0, j = 0, value = 0; i < parse->columns; i++) {
+			if (parse->column_enabled[i]) {
+				if (tpl->column_enabled[i]) {
+					job->sinks[s].src[j++] = value;
 				}
+				value++;
 			}
 		}
 	}
-	edf_signal = 0;
-
-	for (i = 0; i < columns; i++) {
-		if (column_enabled[i]) {
-			if (autoPhysicalMaximum) {
-				sprintf(str, "%.8f", physmax[edf_signal++]);
-				strcat(str, "        ");
-				str[8] = 0;
-				fprintf(outputfile, "%s", str);
-			} else {
-				p = fprintf(outputfile, "%f", physmax[i]);
-				for (j = p; j < 8; j++) {
-					fputc(' ', outputfile);
-				}
 
-				if (edf_format) {
-					sensitivity[edf_signal] = 32767.0 / physmax[i];
-				} else {
-					sensitivity[edf_signal] = 8388607.0 / physmax[i];
-				}
+	return 0;
+}
 
-				sensitivity[edf_signal++] *= multiplier[i];
+/*
+ * Marks the signals of every output which come from columns of integers,
+ * which --exact-integers scales exactly.
+ */
+static void integer_signals(struct conv_job *job,
+		const struct conv_template *parse) {
+	int j, s;
+	struct conv_template *tpl;
+
+	for (s = 0; s < job->nsinks; s++) {
+		tpl = &job->sinks[s].tpl;
+		if (tpl != parse) {
+			for (j = 0; j < tpl->edfsignals; j++) {
+				tpl->integer[j] = parse->integer[job->sinks[s].src[j]];
 			}
 		}
+		tpl->exact_integers = job->exact_integers;
+		select_quantize_kernel(tpl);
 	}
+}
 
-	for (i = 0; i < edfsignals; i++) {
-		if (edf_format) {
-			fprintf(outputfile, "-32768  ");
+/*
+ * Sets the physical maximum and sensitivity of the signals of every output,
+ * from the maxima of the parsed values or from its template.
+ */
+static void finish_physmax(struct conv_job *job, const double *maxima) {
+	int j, s;
+	double gathered[MAX_EDF_SIGNALS];
+	struct conv_template *tpl;
+
+	for (s = 0; s < job->nsinks; s++) {
+		tpl = &job->sinks[s].tpl;
+		if (!tpl->autoPhysicalMaximum) {
+			physmax_manual(tpl);
+		} else if (job->nsinks == 1) {
+			physmax_finish(tpl, maxima);
 		} else {
-			fprintf(outputfile, "-8388608");
+			for (j = 0; j < tpl->edfsignals; j++) {
+				gathered[j] = maxima[job->sinks[s].src[j]];
+			}
+			physmax_finish(tpl, gathered);
 		}
 	}
+}
 
-	for (i = 0; i < edfsignals; i++) {
-		if (edf_format) {
-			fprintf(outputfile, "32767   ");
-		} else {
-			fprintf(outputfile, "8388607 ");
+/* Prints the clipped samples of every signal of every output */
+static void report_clips(const struct conv_job *job,
+		const struct conv_stats *stats) {
+	int i, s;
+	const long long *clips;
+	const struct conv_template *tpl;
+
+	for (s = 0; s < job->nsinks; s++) {
+		tpl = &job->sinks[s].tpl;
+		clips = s ? job->sinks[s].clips : stats->clips;
+		printf("Clipped samples in %s:\n", job->sinks[s].outputfilename);
+		for (i = 0; i < tpl->edfsignals; i++) {
+			printf("  %-16s %lld\n", tpl->signames[tpl->sigcolumn[i]],
+					clips[i]);
+		}
+	}
+}
+
+/* Returns 1 if a sample of any output clipped */
+static int any_clips(const struct conv_job *job, const struct conv_stats *stats) {
+	int i, s;
+	const long long *clips;
+
+	for (s = 0; s < job->nsinks; s++) {
+		clips = s ? job->sinks[s].clips : stats->clips;
+		for (i = 0; i < job->sinks[s].tpl.edfsignals; i++) {
+			if (clips[i]) {
+				return 1;
+			}
 		}
 	}
 
-	for (i = 0; i < (80 * edfsignals); i++) {
-		fputc(' ', outputfile);
+	return 0;
+}
+
+/*
+ * loadTemplate() through the daemon's cache: a template is parsed again only
+ * when its file changed.  Returns nonzero on success, like loadTemplate().
+ */
+static int load_template(const char *path, struct conv_template *tpl) {
+	struct stat st;
+	struct cached_template *c, *slot;
+	int i;
+
+	if (template_cache == NULL || stat(path, &st)) {
+		initSignalTable(tpl);
+		return loadTemplate(path, tpl);
 	}
 
-	if (samplefrequency < 1.0) {
-		for (i = 0; i < edfsignals; i++) {
-			fprintf(outputfile, "1       ");
-			smpls_per_block = 1;
+	pthread_mutex_lock(&template_lock);
+	slot = &template_cache[0];
+	for (i = 0; i < TEMPLATE_CACHE_SIZE; i++) {
+		c = &template_cache[i];
+		if (c->used && !strcmp(c->path, path) && c->size == st.st_size
+				&& c->mtime.tv_sec == st.st_mtim.tv_sec
+				&& c->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+			c->used = ++template_uses;
+			memcpy(tpl, &c->tpl, sizeof(struct conv_template));
+			pthread_mutex_unlock(&template_lock);
+			return 1;
 		}
-	} else {
-		if (((int) samplefrequency) % 10) {
-			for (i = 0; i < edfsignals; i++) {
-				fprintf(outputfile, "%-8i", (int) samplefrequency);
-				smpls_per_block = (int) samplefrequency;
-			}
-		} else {
-			for (i = 0; i < edfsignals; i++) {
-				fprintf(outputfile, "%-8i", ((int) samplefrequency) / 10);
-				smpls_per_block = ((int) samplefrequency) / 10;
-			}
+		if (c->used < slot->used) {
+			slot = c;
 		}
 	}
+	pthread_mutex_unlock(&template_lock);
 
-	for (i = 0; i < (32 * edfsignals); i++) {
-		fputc(' ', outputfile);
+	initSignalTable(tpl);
+	if (!loadTemplate(path, tpl)) {
+		return 0;
 	}
 
-	/***************** start conversion **************************************/
+	pthread_mutex_lock(&template_lock);
+	snprintf(slot->path, MAX_PATH_LENGTH, "%s", path);
+	slot->mtime = st.st_mtim;
+	slot->size = st.st_size;
+	slot->used = ++template_uses;
+	memcpy(&slot->tpl, tpl, sizeof(struct conv_template));
+	pthread_mutex_unlock(&template_lock);
 
-	if (edf_format) {
-		bufsize = smpls_per_block * 2 * edfsignals;
-	} else {
-		bufsize = smpls_per_block * 3 * edfsignals;
+	return 1;
+}
+
+/*
+ * Loads the row index of the csv file or builds it.  With --index it is
+ * kept in <csv_file>.idx for the next run.
+ */
+static int index_rows(const struct conv_job *job, FILE *inputfile,
+		int headersize, struct row_index *index, struct conv_stats *stats) {
+	char path[MAX_PATH_LENGTH + 4];
+	long long size;
+
+	/* binary rows are all of one size */
+	if (job->sinks[0].tpl.binary) {
+		size = input_size(job);
+		if (size < 0) {
+			printf("Can not stat %s", job->path);
+			return 1;
+		}
+		rowindex_fixed(size - headersize, headersize,
+				binary_row_size(&job->sinks[0].tpl), index);
+		return 0;
 	}
 
-	buf = (char *) calloc(1, bufsize);
-	if (buf == NULL ) {
-		printf("Critical error: Malloc error (buf)");
-		fclose(inputfile);
-		fclose(outputfile);
+	snprintf(path, sizeof(path), "%s.idx", job->path);
+	if (job->index && !rowindex_load(path, job->path, headersize, index)) {
+		return 0;
+	}
+
+	if (rowindex_build(inputfile, job->path, headersize, index)) {
 		return 1;
 	}
+	stats->bytes_read += ftell(inputfile) - headersize;
 
-	fseek(inputfile, (long long) headersize, SEEK_SET);
-	i = 0;
-	k = 0;
-	column = 0;
-	column_end = 1;
-	datarecords = 0;
-	str_start = 0;
-	edf_signal = 0;
-	line_nr = startline;
+	if (job->index && rowindex_save(path, index)) {
+		printf("Can not write row index %s\n", path);
+	}
 
-	while (1) {
-		temp = fgetc(inputfile);
+	return 0;
+}
 
-		if (temp == EOF) {
-			break;
+/*
+ * Returns the length of the rows if all rows are that long, judging by the
+ * first ones, by the size of the data and by rows spread over the file;
+ * 0 otherwise.
+ */
+static int fixed_row_length(FILE *inputfile, int headersize,
+		long long datasize) {
+	/* room for the first 16 rows at the longest */
+	char block[16 * (MAX_LINE_LENGTH + 1)];
+	const char *p, *end;
+	long long rows, row;
+	int i, n, length = 0;
+
+	fseek(inputfile, (long long) headersize, SEEK_SET);
+	n = fread(block, 1, sizeof(block), inputfile);
+	end = block + n;
+	for (i = 0, p = block; i < 16; i++, p += length) {
+		end = (const char *) memchr(p, '\n', block + n - p);
+		if (end == NULL || (i > 0 && end + 1 - p != length)) {
+			return 0;
 		}
+		length = end + 1 - p;
+	}
 
-		line[i] = temp;
+	if (datasize % length) {
+		return 0;
+	}
 
-		if (line[i] == '\r') {
+	/* the rows at 16 places in the file must end where expected */
+	rows = datasize / length;
+	for (i = 1; i <= 16; i++) {
+		row = rows * i / 17;
+		if (row == 0) {
 			continue;
 		}
-
-		if (separator != ',') {
-			if (line[i] == ',') {
-				line[i] = '.';
-			}
+		fseek(inputfile, (long long) headersize + row * length - 1, SEEK_SET);
+		if (fread(block, 1, length + 1, inputfile) != (size_t) length + 1
+				|| block[0] != '\n' || block[length] != '\n'
+				|| memchr(block + 1, '\n', length - 1) != NULL) {
+			return 0;
 		}
+	}
 
-		if (line[i] == separator) {
-			if (!column_end) {
-				if (column_enabled[column]) {
-					value[edf_signal] = atof(line + str_start);
+	return length;
+}
 
-					edf_signal++;
-				}
-				column_end = 1;
-				column++;
-			}
-		} else {
-			if (line[i] != '\n') {
-				if (column_end) {
-					str_start = i;
-					column_end = 0;
-				}
+/*
+ * Finds the rows to convert from --from and --to.  The rows are found
+ * through the row index if there is one, computed if all rows have the
+ * same length, and indexed otherwise.
+ */
+static int find_range(struct conv_job *job, FILE *inputfile, int headersize,
+		long long datasize, struct row_index *index, struct conv_stats *stats,
+		struct conv_progress *progress) {
+	double rate = job->sinks[0].tpl.samplefrequency, late;
+	long long total = -1, end_offset = -1, lead, rows;
+	int length = 0;
+
+	job->start_row = job->from_rows ? (long long) job->from
+			: (long long) floor(job->from * rate + 0.5);
+	job->end_row = job->to < 0 ? -1 : job->to_rows ? (long long) job->to
+			: (long long) floor(job->to * rate + 0.5);
+	lead = job->decimate > 1 ? DECIMATE_HALF_TAPS * job->decimate : 0;
+	job->first_row = job->start_row > lead ? job->start_row - lead : 0;
+	job->first_offset = 0;
+	job->range_size = datasize;
+	job->start_seconds = 0;
+
+	if (job->end_row >= 0 && job->end_row <= job->start_row) {
+		printf("Error: --to must come after --from");
+		return 1;
+	}
+
+	if (job->row_index == NULL && job->sinks[0].tpl.binary) {
+		length = binary_row_size(&job->sinks[0].tpl);
+	} else if (job->row_index == NULL
+			&& (job->first_row > 0 || job->end_row >= 0)) {
+		length = fixed_row_length(inputfile, headersize, datasize);
+		if (length == 0) {
+			progress_phase(progress, "index", 1);
+			stats_begin(stats);
+			if (index_rows(job, inputfile, headersize, index, stats)) {
+				return 1;
 			}
+			stats_end(stats, PHASE_INDEX);
+			job->row_index = index;
 		}
+	}
 
-		if (line[i] == '\n') {
-			if (!column_end) {
-				if (column_enabled[column]) {
-					value[edf_signal] = atof(line + str_start);
-					edf_signal++;
-				}
-				column++;
-				column_end = 1;
-			}
+	if (job->row_index != NULL) {
+		total = job->row_index->rows;
+	} else if (length > 0) {
+		total = datasize / length;
+	}
 
-			if (column != columns) {
-				for (j = 0; j < 10; j++) {
-					if (fgetc(inputfile) == EOF) {
-						break; /* ignore error because we reached the end of the file */
-					} /* added this code because some ascii-files stop abruptly in */
-				} /* the middle of a row but they do put a newline-character at the end */
+	if (job->first_row > 0) {
+		if (job->first_row >= total && total >= 0) {
+			printf("Error: --from is past the end of %s", job->path);
+			return 1;
+		}
+		job->first_offset = length > 0 ? job->first_row * length
+				: rowindex_seek(inputfile, job->row_index, job->first_row);
+	}
+	if (job->end_row >= 0 && job->end_row < total) {
+		end_offset = length > 0 ? job->end_row * length
+				: rowindex_seek(inputfile, job->row_index, job->end_row);
+	}
+	job->range_size = (end_offset >= 0 ? end_offset : datasize)
+			- job->first_offset;
+
+	/* the header holds the start time in whole seconds */
+	job->start_seconds = (long long) floor(job->start_row / rate + 1e-9);
+	late = job->start_row / rate - job->start_seconds;
+	if (late > 1e-9) {
+		printf("Note: the first sample is %f s after the start time in the header\n",
+				late);
+	}
 
-				if (j < 10) {
-					break;
-				}
+	if (total >= 0) {
+		rows = (job->end_row >= 0 && job->end_row < total ? job->end_row
+				: total) - job->start_row;
+		progress->total_rows = rows;
+		progress->total_datarecords = (rows + job->decimate - 1)
+				/ job->decimate / job->smpls_per_block;
+	}
 
-				printf("Error, number of columns in line %i is wrong.\n",
-						line_nr);
-				fclose(inputfile);
-				fclose(outputfile);
-				free(buf);
-				return 1;
-			}
+	return 0;
+}
 
-			line_nr++;
+/*
+ * Bytes of buffers one conversion holds at once with the given i/o backend:
+ * the csv file's, then either the percentile sketches while the physical
+ * maxima are found, or for every output file its datarecord, its file
+ * buffer and the --signal-stats and --hash state, and the decimation filter.
+ * rows is the size of a datarecord of one sample per signal, for all
+ * outputs together.
+ */
+static long long conversion_memory(const struct conv_job *job,
+		const struct conv_template *parse, int io, long long *rows) {
+	long long outputs = 0, sketches = 0;
+	int s, taps;
+
+	*rows = 0;
+	for (s = 0; s < job->nsinks; s++) {
+		*rows += datarecord_size(&job->sinks[s].tpl, 1);
+		outputs += io_buffer_size(io);
+		if (job->signal_stats) {
+			outputs += sizeof(struct signal_stats);
+		}
+		if (job->hash) {
+			outputs += sizeof(struct output_hash);
+		}
+	}
+	outputs += *rows * job->smpls_per_block;
 
-			for (j = 0; j < edfsignals; j++) {
-				temp = (int) (value[j] * sensitivity[j]);
+	if (job->decimate > 1) {
+		taps = 2 * DECIMATE_HALF_TAPS * job->decimate + 1;
+		outputs += sizeof(double) * (taps + 2LL * taps * parse->edfsignals
+				+ parse->edfsignals);
+	}
+	if (job->physmax_percentile > 0.0) {
+		sketches = sizeof(struct quantile_sketch) * parse->edfsignals;
+	}
 
-				if (edf_format) {
-					if (temp > 32767)
-						temp = 32767;
+	return io_buffer_size(io) + (sketches > outputs ? sketches : outputs);
+}
 
-					if (temp < -32768)
-						temp = -32768;
+/*
+ * Fits the buffers of the conversion into job->max_memory: io_uring gives
+ * way to stdio, datarecords get fewer samples and split segments are
+ * written by fewer threads, in that order.  Returns 1 if the conversion
+ * does not fit at all.
+ */
+static int fit_memory(struct conv_job *job, const struct conv_template *parse,
+		struct conv_stats *stats) {
+	long long need, rows, input;
+	int split = job->split_seconds > 0 || job->split_bytes > 0;
+
+	need = conversion_memory(job, parse, job->io, &rows);
+	if (need > job->max_memory && job->io != IO_STDIO) {
+		printf("io_uring buffers do not fit in %lld bytes, using stdio\n",
+				job->max_memory);
+		job->io = IO_STDIO;
+		need = conversion_memory(job, parse, job->io, &rows);
+	}
 
-					*(((short *) buf) + k + (j * smpls_per_block)) =
-							(short) temp;
-				} else {
-					if (temp > 8388607)
-						temp = 8388607;
+	/* split segments each read the csv file again */
+	input = split ? io_buffer_size(job->io) : 0;
+	if (need + input > job->max_memory
+			&& datarecord_limit(rows, job->max_memory - input
+					- (need - rows * job->smpls_per_block),
+					&job->smpls_per_block, &job->datrecduration)) {
+		printf("Error: %lld bytes of memory are not enough for the buffers"
+				" of this conversion.", job->max_memory);
+		return 1;
+	}
+	need = conversion_memory(job, parse, job->io, &rows);
 
-					if (temp < -8388608)
-						temp = -8388608;
+	if (split) {
+		if (job->workers > (job->max_memory - input) / need) {
+			job->workers = (int) ((job->max_memory - input) / need);
+		}
+		need = input + need * job->workers;
+	}
 
-					p = (k + (j * smpls_per_block)) * 3;
+	stats->memory_budget = job->max_memory;
+	stats->memory_planned = need;
+	return 0;
+}
 
-					buf[p++] = temp & 0xff;
-					buf[p++] = (temp >> 8) & 0xff;
-					buf[p] = (temp >> 16) & 0xff;
-				}
-			}
-			k++;
+static int convert_file(struct conv_job *job, struct conv_template *parse,
+		struct row_index *index, struct conv_stats *stats,
+		struct conv_progress *progress) {
+	int s, headersize, sampled = 0, automax = 0, segments = 0;
+	long long datasize = 0, bytes;
+	char ckpath[MAX_PATH_LENGTH];
+	char first[MAX_PATH_LENGTH], last[MAX_PATH_LENGTH];
+	double ratio;
+	double maxima[MAX_EDF_SIGNALS];
+	FILE *inputfile;
+	struct conv_template *tpl = &job->sinks[0].tpl;
+	struct quantile_sketch *sketches = NULL;
+
+	if (!strcmp(job->path, "")) {
+		printf("Path is null");
+		return 1;
+	}
 
-			if (k >= smpls_per_block) {
-				if (fwrite(buf, bufsize, 1, outputfile) != 1) {
-					printf("Error: Write error during conversion.");
-					fclose(inputfile);
-					fclose(outputfile);
-					free(buf);
-					return 1;
-				}
-				datarecords++;
-				k = 0;
-			}
+	if (npy_probe(job->path, &job->npy) < 0) {
+		return 1;
+	}
+	inputfile = open_input(job);
+	if (inputfile == NULL ) {
+		printf("Failed to open infile for reading");
+		return 1;
+	}
 
-			str_start = 0;
-			i = 0;
-			column = 0;
-			column_end = 1;
-			edf_signal = 0;
-			continue;
+	progress_phase(progress, "template", 1);
+	stats_begin(stats);
+	for (s = 0; s < job->nsinks; s++) {
+		if (!load_template(job->sinks[s].template_path, &job->sinks[s].tpl)) {
+			fclose(inputfile);
+			return (1);
 		}
-		i++;
-
-		if (i > 2046) {
-			printf("Error, line %i is too long.\n", line_nr);
+		if (job->npy.type != BINARY_NONE && npy_template(job,
+				job->sinks[s].template_path, &job->sinks[s].tpl)) {
 			fclose(inputfile);
-			fclose(outputfile);
-			free(buf);
 			return 1;
 		}
+		automax |= job->sinks[s].tpl.autoPhysicalMaximum;
 	}
-
-	fseek(outputfile, 236LL, SEEK_SET);
-	fprintf(outputfile, "%-8i", datarecords);
-	free(buf);
-
-	if (fclose(outputfile)) {
-		printf("Error: An error occurred when closing outputfile.");
+	if (job->nsinks == 1) {
+		parse = tpl;
+	} else if (shared_columns(job, parse)) {
 		fclose(inputfile);
 		return 1;
 	}
+	stats_end(stats, PHASE_TEMPLATE);
+
+	if (job->decimate_to > 0.0) {
+		ratio = tpl->samplefrequency / job->decimate_to;
+		job->decimate = (int) (ratio + 0.5);
+		if (job->decimate < 2 || fabs(ratio - job->decimate) > 1e-6 * ratio) {
+			printf("Error: samplefrequency %f is not a multiple of %f.",
+					tpl->samplefrequency, job->decimate_to);
+			fclose(inputfile);
+			return 1;
+		}
+	}
+	datarecord_params(tpl->samplefrequency / job->decimate,
+			&job->smpls_per_block, &job->datrecduration);
+	if (job->record_size > 0 || job->record_align > 0) {
+		datarecord_fit(tpl,
+				job->record_size > 0 ? job->record_size : EDF_MAX_RECORD_SIZE,
+				job->record_align, &job->smpls_per_block, &job->datrecduration);
+	}
 
-	if (fclose(inputfile)) {
-		printf("Error: An error occurred when closing inputfile.");
-		return 1;
+	if (job->max_memory > 0) {
+		s = job->io;
+		if (fit_memory(job, parse, stats)) {
+			fclose(inputfile);
+			return 1;
+		}
+		if (job->io != s) {
+			fclose(inputfile);
+			inputfile = open_input(job);
+			if (inputfile == NULL) {
+				printf("Failed to open infile for reading");
+				return 1;
+			}
+		}
 	}
 
-	printf("Done. EDF file is located at %s\n", outputfilename);
+	progress_phase(progress, "check", 1);
+	stats_begin(stats);
+	if (check_file(inputfile, parse, &headersize)) {
+		fclose(inputfile);
+		return 1;
+	}
+	stats->bytes_read += ftell(inputfile);
+	select_file_kernels(inputfile, parse, headersize);
+	integer_signals(job, parse);
+	stats_end(stats, PHASE_CHECK);
+
+	/* splitting looks up the segment starts in the index */
+	if (job->index || job->split_seconds > 0 || job->split_bytes > 0) {
+		progress_phase(progress, "index", 1);
+		stats_begin(stats);
+		if (index_rows(job, inputfile, headersize, index, stats)) {
+			fclose(inputfile);
+			return 1;
+		}
+		stats_end(stats, PHASE_INDEX);
 
-	return 0;
-}
+		job->row_index = index;
+	}
 
-int loadTemplate(char * path) {
-	int i, temp;
-	/*char path[MAX_PATH_LENGTH];*/
-	char *content;
-	double f_temp;
-	struct xml_handle *xml_hdl;
+	datasize = input_size(job);
+	datasize = datasize < 0 ? 0 : datasize - headersize;
 
-	if (!strcmp(path, "")) {
+	if (find_range(job, inputfile, headersize, datasize, index, stats,
+			progress)) {
+		fclose(inputfile);
 		return 1;
 	}
 
-	xml_hdl = xml_get_handle(path);
-	if (xml_hdl == NULL ) {
-		printf("Error Can not open template file for reading.");
-		return 0;
+	if (automax && job->physmax_samples > 0
+			&& (long long) job->physmax_samples * PHYSMAX_SAMPLE_BLOCK
+					< job->range_size) {
+		sampled = 1;
 	}
-
-	if (strcmp(xml_hdl->elementname, "EDFbrowser_ascii2edf_template")) {
-		printf("Error There seems to be an error in this template.");
-		xml_close(xml_hdl);
-		return 0;
+	if (job->resume) {
+		checkpoint_path(job, ckpath);
+		job->resuming = !access(ckpath, F_OK);
+		if (!job->resuming) {
+			printf("No checkpoint %s, converting from the start\n", ckpath);
+		}
 	}
 
-	if (xml_goto_nth_element_inside(xml_hdl, "separator", 0)) {
-		printf("Error There seems to be an error in this template.");
-		xml_close(xml_hdl);
-		return 0;
+	progress->total_bytes = job->range_size;
+	progress->passes = (automax && !sampled && !job->resuming) ? 2 : 1;
+
+	stats_begin(stats);
+	if (automax && job->physmax_percentile > 0.0 && !job->resuming) {
+		sketches = (struct quantile_sketch *) malloc(
+				sizeof(struct quantile_sketch) * parse->edfsignals);
+		if (sketches == NULL) {
+			printf("Critical error: Malloc error (quantile sketch)");
+			fclose(inputfile);
+			return 1;
+		}
 	}
-	content = xml_get_content_of_element(xml_hdl);
-	if (!strcmp(content, "tab")) {
-		separator = '\t';
-		free(content);
-	} else {
-		if (strlen(content) != 1) {
-			printf("Error There seems to be an error in this template.");
-			free(content);
-			xml_close(xml_hdl);
-			return 0;
+	if (job->resuming) {
+		/* the physical maxima are restored with the rest of the state */
+		stats->physmax_method = "checkpoint";
+	} else if (automax) {
+		progress_phase(progress, "physmax", 1);
+		if (sampled) {
+			bytes = sample_physmax(inputfile, parse,
+					(long long) headersize + job->first_offset, job->range_size,
+					job, maxima, sketches);
+			if (bytes < 0) {
+				free(sketches);
+				fclose(inputfile);
+				return 1;
+			}
+			stats->bytes_read += bytes;
+			stats->physmax_method = sketches ? "sampled percentile" : "sampled";
 		} else {
-			if ((content[0] < 32) || (content[0] > 126)) {
-				printf("Error There seems to be an error in this template.");
-				free(content);
-				xml_close(xml_hdl);
-				return 0;
+			if (scan_physmax(inputfile, parse, headersize, job, maxima,
+					sketches, progress)) {
+				free(sketches);
+				fclose(inputfile);
+				return 1;
 			}
-			separator = content[0];
-			free(content);
+			stats->bytes_read += ftell(inputfile) - headersize
+					- job->first_offset;
+			stats->physmax_method = sketches ? "percentile" : "full";
 		}
+	} else {
+		stats->physmax_method = "template";
 	}
-	xml_go_up(xml_hdl);
-
-	if (xml_goto_nth_element_inside(xml_hdl, "columns", 0)) {
-		printf("Error There seems to be an error in this template.");
-		xml_close(xml_hdl);
-		return 0;
+	free(sketches);
+	if (!job->resuming) {
+		finish_physmax(job, maxima);
 	}
-	content = xml_get_content_of_element(xml_hdl);
-	temp = atoi(content);
-	free(content);
-	if ((temp < 1) || (temp > 256)) {
-		printf("Error There seems to be an error in this template.");
-		xml_close(xml_hdl);
-		return 0;
+	stats_end(stats, PHASE_PHYSMAX);
+
+	if (write_output(job, parse, inputfile, headersize, stats, progress,
+			&segments)) {
+		fclose(inputfile);
+		return 1;
 	}
-	columns = temp; /*Set number of columns*/
-	xml_go_up(xml_hdl);
 
-	if (xml_goto_nth_element_inside(xml_hdl, "startline", 0)) {
-		printf("Error There seems to be an error in this template.");
-		xml_close(xml_hdl);
-		return 0;
+	if (sampled && job->physmax_fallback && any_clips(job, stats)) {
+		/* the estimate was too low, redo it the exact way */
+		job->resuming = 0;
+		progress->passes = 3;
+		progress_phase(progress, "physmax", 2);
+		stats_begin(stats);
+		if (scan_physmax(inputfile, parse, headersize, job, maxima, NULL,
+				progress)) {
+			fclose(inputfile);
+			return 1;
+		}
+		stats->bytes_read += ftell(inputfile) - headersize
+				- job->first_offset;
+		stats->physmax_method = "sampled, rescanned after clipping";
+		finish_physmax(job, maxima);
+		stats_end(stats, PHASE_PHYSMAX);
+
+		memset(stats->clips, 0, sizeof(stats->clips));
+		for (s = 1; s < job->nsinks; s++) {
+			memset(job->sinks[s].clips, 0, sizeof(job->sinks[s].clips));
+		}
+		stats->rows = 0;
+		stats->datarecords = 0;
+		stats->bytes_written = 0;
+		if (write_output(job, parse, inputfile, headersize, stats, progress,
+				&segments)) {
+			fclose(inputfile);
+			return 1;
+		}
 	}
-	content = xml_get_content_of_element(xml_hdl);
-	temp = atoi(content);
-	free(content);
-	if ((temp < 1) || (temp > 100)) {
-		printf("Error There seems to be an error in this template.");
-		xml_close(xml_hdl);
-		return 0;
+
+	if (fclose(inputfile)) {
+		printf("Error: An error occurred when closing inputfile.");
+		return 1;
 	}
-	startline = temp;
-	xml_go_up(xml_hdl);
 
-	if (xml_goto_nth_element_inside(xml_hdl, "samplefrequency", 0)) {
-		printf("Error There seems to be an error in this template.");
-		xml_close(xml_hdl);
-		return 0;
+	if (segments > 0) {
+		segment_filename(job->outputfilename, 0, first);
+		segment_filename(job->outputfilename, segments - 1, last);
 	}
-	content = xml_get_content_of_element(xml_hdl);
-	f_temp = atof(content);
-	free(content);
-	if ((f_temp < 0.0000001) || (f_temp > 1000000.0)) {
-		printf("Error There seems to be an error in this template.");
-		xml_close(xml_hdl);
-		return 0;
+	if (segments == 1) {
+		printf("Done. EDF file is located at %s\n", first);
+	} else if (segments > 1) {
+		printf("Done. %d EDF files are located at %s to %s\n", segments,
+				first, last);
+	}
+	for (s = 0; segments == 0 && s < job->nsinks; s++) {
+		printf("Done. EDF file is located at %s\n",
+				job->sinks[s].outputfilename);
 	}
-	samplefrequency = f_temp;
-	xml_go_up(xml_hdl);
 
-	if (!(xml_goto_nth_element_inside(xml_hdl, "autophysicalmaximum", 0))) {
-		content = xml_get_content_of_element(xml_hdl);
-		autoPhysicalMaximum = atoi(content);
-		free(content);
-		if ((autoPhysicalMaximum < 0) || (autoPhysicalMaximum > 1)) {
-			autoPhysicalMaximum = 1;
-		}
-		xml_go_up(xml_hdl);
+	/* percentiles clip the samples above them on purpose */
+	if (job->physmax_percentile > 0.0) {
+		report_clips(job, stats);
 	}
 
-	if (!(xml_goto_nth_element_inside(xml_hdl, "edf_format", 0))) {
-		content = xml_get_content_of_element(xml_hdl);
-		edf_format = atoi(content);
-		free(content);
-		if ((edf_format < 0) || (edf_format > 1)) {
-			edf_format = 0;
-		}
-		xml_go_up(xml_hdl);
+	if (job->max_memory > 0) {
+		printf("Memory: %lld bytes of buffers within %lld, peak RSS %ld kB\n",
+				stats->memory_planned, job->max_memory, stats_peak_rss());
 	}
 
-	for (i = 0; i < columns; i++) {
-		if (xml_goto_nth_element_inside(xml_hdl, "signalparams", i)) {
-			printf("Error There seems to be an error in this template.");
-			xml_close(xml_hdl);
-			return 0;
-		}
+	if (stats->mode) {
+		fflush(stdout);
+		stats_print(job->stats_out, stats, tpl);
+	}
 
-		if (xml_goto_nth_element_inside(xml_hdl, "checked", 0)) {
-			printf("Error There seems to be an error in this template.");
-			xml_close(xml_hdl);
-			return 0;
-		}
-		content = xml_get_content_of_element(xml_hdl);
-		if (!strcmp(content, "0")) {
-			column_enabled[i] = 0;
-		} else {
-			column_enabled[i] = 1;
-			edfsignals++;
-		}
-		free(content);
-		xml_go_up(xml_hdl);
+	return 0;
+}
 
-		if (xml_goto_nth_element_inside(xml_hdl, "label", 0)) {
-			printf("Error There seems to be an error in this template.");
-			xml_close(xml_hdl);
-			return 0;
-		}
-		content = xml_get_content_of_element(xml_hdl);
-		strcpy(signames[i], content);
-		free(content);
-		xml_go_up(xml_hdl);
+int convert(struct conv_job *job, struct conv_stats *stats,
+		struct conv_progress *progress) {
+	int s, result;
+	const char *comma;
+	struct conv_template *parse = NULL;
+	struct row_index index;
+
+	job->sinks = (struct conv_sink *) calloc(job->nsinks,
+			sizeof(struct conv_sink));
+	if (job->nsinks > 1) {
+		parse = (struct conv_template *) malloc(sizeof(struct conv_template));
+	}
+	if (job->sinks == NULL || (job->nsinks > 1 && parse == NULL)) {
+		printf("Critical error: Malloc error (outputs)");
+		free(job->sinks);
+		return 1;
+	}
 
-		if (xml_goto_nth_element_inside(xml_hdl, "physical_maximum", 0)) {
-			printf("Error There seems to be an error in this template.");
-			xml_close(xml_hdl);
-			return 0;
-		}
-		content = xml_get_content_of_element(xml_hdl);
-		physmax[i] = atof(content);
-		free(content);
-		xml_go_up(xml_hdl);
+	snprintf(job->sinks[0].template_path, MAX_PATH_LENGTH, "%s",
+			job->template_path);
+	snprintf(job->sinks[0].outputfilename, MAX_PATH_LENGTH, "%s",
+			job->outputfilename);
+	for (s = 1; s < job->nsinks; s++) {
+		comma = strchr(job->also[s - 1], ',');
+		snprintf(job->sinks[s].template_path, MAX_PATH_LENGTH, "%.*s",
+				(int) (comma - job->also[s - 1]), job->also[s - 1]);
+		snprintf(job->sinks[s].outputfilename, MAX_PATH_LENGTH, "%s",
+				comma + 1);
+	}
 
-		if (xml_goto_nth_element_inside(xml_hdl, "physical_dimension", 0)) {
-			printf("Error There seems to be an error in this template.");
-			xml_close(xml_hdl);
-			return 0;
-		}
-		content = xml_get_content_of_element(xml_hdl);
-		strcpy(sigdimensions[i], content);
-		free(content);
-		xml_go_up(xml_hdl);
+	memset(&index, 0, sizeof(index));
+	job->row_index = NULL;
 
-		if (xml_goto_nth_element_inside(xml_hdl, "multiplier", 0)) {
-			printf("Error There seems to be an error in this template.");
-			xml_close(xml_hdl);
-			return 0;
-		}
-		content = xml_get_content_of_element(xml_hdl);
-		multiplier[i] = atof(content);
-		free(content);
-		xml_go_up(xml_hdl);
-		xml_go_up(xml_hdl);
-	}
-	xml_close(xml_hdl);
-	return 1;
-}
+	result = convert_file(job, parse, &index, stats, progress);
 
-void initSignalTable() {
-	int i;
-	edfsignals = 0;
-	for (i = 0; i < MAX_EDF_SIGNALS; i++) {
-		physmax[i] = 0;
-		multiplier[i] = 1.000;
-		column_enabled[i] = 0;
-	}
-}
-
-void latin1_to_ascii(char *str, int len) {
-  int i, value;
-  for(i=0; i<len; i++) {
-    value = *((unsigned char *)(str + i));
-    if((value>31)&&(value<127)) {
-    	continue;
-    }
-
-    switch(value) {
-      case 128 : str[i] = 'E';  break;
-      case 130 : str[i] = ',';  break;
-      case 131 : str[i] = 'F';  break;
-      case 132 : str[i] = '\"';  break;
-      case 133 : str[i] = '.';  break;
-      case 134 : str[i] = '+';  break;
-      case 135 : str[i] = '+';  break;
-      case 136 : str[i] = '^';  break;
-      case 137 : str[i] = 'm';  break;
-      case 138 : str[i] = 'S';  break;
-      case 139 : str[i] = '<';  break;
-      case 140 : str[i] = 'E';  break;
-      case 142 : str[i] = 'Z';  break;
-      case 145 : str[i] = '`';  break;
-      case 146 : str[i] = '\'';  break;
-      case 147 : str[i] = '\"';  break;
-      case 148 : str[i] = '\"';  break;
-      case 149 : str[i] = '.';  break;
-      case 150 : str[i] = '-';  break;
-      case 151 : str[i] = '-';  break;
-      case 152 : str[i] = '~';  break;
-      case 154 : str[i] = 's';  break;
-      case 155 : str[i] = '>';  break;
-      case 156 : str[i] = 'e';  break;
-      case 158 : str[i] = 'z';  break;
-      case 159 : str[i] = 'Y';  break;
-      case 171 : str[i] = '<';  break;
-      case 180 : str[i] = '\'';  break;
-      case 181 : str[i] = 'u';  break;
-      case 187 : str[i] = '>';  break;
-      case 191 : str[i] = '\?';  break;
-      case 192 : str[i] = 'A';  break;
-      case 193 : str[i] = 'A';  break;
-      case 194 : str[i] = 'A';  break;
-      case 195 : str[i] = 'A';  break;
-      case 196 : str[i] = 'A';  break;
-      case 197 : str[i] = 'A';  break;
-      case 198 : str[i] = 'E';  break;
-      case 199 : str[i] = 'C';  break;
-      case 200 : str[i] = 'E';  break;
-      case 201 : str[i] = 'E';  break;
-      case 202 : str[i] = 'E';  break;
-      case 203 : str[i] = 'E';  break;
-      case 204 : str[i] = 'I';  break;
-      case 205 : str[i] = 'I';  break;
-      case 206 : str[i] = 'I';  break;
-      case 207 : str[i] = 'I';  break;
-      case 208 : str[i] = 'D';  break;
-      case 209 : str[i] = 'N';  break;
-      case 210 : str[i] = 'O';  break;
-      case 211 : str[i] = 'O';  break;
-      case 212 : str[i] = 'O';  break;
-      case 213 : str[i] = 'O';  break;
-      case 214 : str[i] = 'O';  break;
-      case 215 : str[i] = 'x';  break;
-      case 216 : str[i] = 'O';  break;
-      case 217 : str[i] = 'U';  break;
-      case 218 : str[i] = 'U';  break;
-      case 219 : str[i] = 'U';  break;
-      case 220 : str[i] = 'U';  break;
-      case 221 : str[i] = 'Y';  break;
-      case 222 : str[i] = 'I';  break;
-      case 223 : str[i] = 's';  break;
-      case 224 : str[i] = 'a';  break;
-      case 225 : str[i] = 'a';  break;
-      case 226 : str[i] = 'a';  break;
-      case 227 : str[i] = 'a';  break;
-      case 228 : str[i] = 'a';  break;
-      case 229 : str[i] = 'a';  break;
-      case 230 : str[i] = 'e';  break;
-      case 231 : str[i] = 'c';  break;
-      case 232 : str[i] = 'e';  break;
-      case 233 : str[i] = 'e';  break;
-      case 234 : str[i] = 'e';  break;
-      case 235 : str[i] = 'e';  break;
-      case 236 : str[i] = 'i';  break;
-      case 237 : str[i] = 'i';  break;
-      case 238 : str[i] = 'i';  break;
-      case 239 : str[i] = 'i';  break;
-      case 240 : str[i] = 'd';  break;
-      case 241 : str[i] = 'n';  break;
-      case 242 : str[i] = 'o';  break;
-      case 243 : str[i] = 'o';  break;
-      case 244 : str[i] = 'o';  break;
-      case 245 : str[i] = 'o';  break;
-      case 246 : str[i] = 'o';  break;
-      case 247 : str[i] = '-';  break;
-      case 248 : str[i] = '0';  break;
-      case 249 : str[i] = 'u';  break;
-      case 250 : str[i] = 'u';  break;
-      case 251 : str[i] = 'u';  break;
-      case 252 : str[i] = 'u';  break;
-      case 253 : str[i] = 'y';  break;
-      case 254 : str[i] = 't';  break;
-      case 255 : str[i] = 'y';  break;
-      default  : str[i] = ' ';  break;
-    }
-  }
+	rowindex_free(&index);
+	job->row_index = NULL;
+	free(parse);
+	free(job->sinks);
+	job->sinks = NULL;
+
+	return result;
 }
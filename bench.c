@@ -0,0 +1,767 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Microbenchmarks for the kernels of ascii2edf.  Synthetic csv data is
+ * generated in memory from a fixed seed for every combination of column
+ * count and value format, so runs are repeatable between machines.
+ * Every benchmark reports the median of a number of runs as ns/byte,
+ * rows/s and MB/s.  For the row kernels the byte count is the size of the
+ * csv text, so the figures compare directly with file throughput.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#include "convert.h"
+#include "decimate.h"
+#include "rowindex.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <charconv>
+
+#define MAX_CONFIGS 16
+
+struct bench_data {
+	char *text; /* csv rows, each terminated by '\n' */
+	long long textsize;
+	int rows;
+	int *row_start;
+	int *row_len;
+	int *field_start; /* rows * edfsignals */
+	double *values; /* rows * edfsignals */
+	struct conv_template tpl;
+};
+
+static int repeat = 5;
+static volatile double sink;
+static unsigned int lcg_state;
+
+static unsigned int lcg(void) {
+	lcg_state = lcg_state * 1103515245u + 12345u;
+	return (lcg_state >> 8) & 0xffffff;
+}
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_double(const void *a, const void *b) {
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+static void report(const char *name, const char *config, double *times,
+		double bytes, double rows) {
+	double t;
+
+	qsort(times, repeat, sizeof(double), cmp_double);
+	t = times[repeat / 2];
+
+	printf("%-24s %-22s %9.3f ns/byte %14.0f rows/s %10.1f MB/s\n", name,
+			config, t * 1e9 / bytes, rows / t, bytes / t / 1e6);
+}
+
+/***************** number parsers ***************************************/
+
+static double parse_strtod(const char *s) {
+	return strtod(s, NULL);
+}
+
+static double parse_from_chars(const char *s) {
+	double d = 0.0;
+
+	while (*s == ' ' || *s == '\t') {
+		s++;
+	}
+	if (*s == '+') {
+		s++;
+	}
+	std::from_chars(s, s + 64, d);
+	return d;
+}
+
+/*
+ * Decimal parser using the exact fast path of Clinger: a mantissa of at most
+ * 15 digits divided by an exactly representable power of ten is correctly
+ * rounded.  Anything else is handed to strtod.
+ */
+static double parse_decimal(const char *s) {
+	static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+			1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+			1e19, 1e20, 1e21, 1e22 };
+	const char *p = s;
+	long long mantissa = 0;
+	int digits = 0, frac = 0, negative = 0;
+	double d;
+
+	while (*p == ' ' || *p == '\t') {
+		p++;
+	}
+	if (*p == '-' || *p == '+') {
+		negative = (*p == '-');
+		p++;
+	}
+	while (*p >= '0' && *p <= '9') {
+		mantissa = mantissa * 10 + (*p++ - '0');
+		digits++;
+	}
+	if (*p == '.') {
+		p++;
+		while (*p >= '0' && *p <= '9') {
+			mantissa = mantissa * 10 + (*p++ - '0');
+			digits++;
+			frac++;
+		}
+	}
+	if (digits == 0 || digits > 15 || *p == 'e' || *p == 'E') {
+		return strtod(s, NULL);
+	}
+	d = (double) mantissa / pow10[frac];
+	return negative ? -d : d;
+}
+
+struct number_parser {
+	const char *name;
+	double (*parse)(const char *);
+};
+
+static const struct number_parser parsers[] = { { "parse/atof", atof }, {
+		"parse/strtod", parse_strtod }, { "parse/from_chars", parse_from_chars },
+		{ "parse/decimal", parse_decimal } };
+
+/***************** data *************************************************/
+
+static int integer_format(const char *format) {
+	const char *conv = format + strlen(format) - 1;
+
+	return (*conv == 'd' || *conv == 'i');
+}
+
+static void setup_template(struct conv_template *tpl, int columns,
+		char separator, int edf_format) {
+	int i;
+
+	initSignalTable(tpl);
+	tpl->separator = separator;
+	tpl->columns = columns;
+	tpl->startline = 1;
+	tpl->samplefrequency = 256.0;
+	tpl->autoPhysicalMaximum = 1;
+	tpl->edf_format = edf_format;
+	for (i = 0; i < columns; i++) {
+		tpl->column_enabled[i] = (i < MAX_EDF_SIGNALS);
+		if (tpl->column_enabled[i]) {
+			tpl->edfsignals++;
+		}
+		tpl->physmax[i] = 1000.0;
+		snprintf(tpl->signames[i], 128, "Signal %d", i);
+		snprintf(tpl->sigdimensions[i], 128, "uV");
+	}
+	select_kernels(tpl, LINES_LF);
+}
+
+static int generate(struct bench_data *d, int rows, int columns,
+		const char *format, char separator) {
+	int r, c, n, pos, integer = integer_format(format);
+	long long capacity = 0;
+	char field[128];
+
+	memset(d, 0, sizeof(*d));
+	setup_template(&d->tpl, columns, separator, 1);
+	lcg_state = 1;
+
+	d->rows = rows;
+	d->row_start = (int *) malloc(sizeof(int) * rows);
+	d->row_len = (int *) malloc(sizeof(int) * rows);
+	d->field_start = (int *) malloc(sizeof(int) * rows * d->tpl.edfsignals);
+	d->values = (double *) malloc(sizeof(double) * rows * d->tpl.edfsignals);
+	if (!d->row_start || !d->row_len || !d->field_start || !d->values) {
+		return 1;
+	}
+
+	pos = 0;
+	for (r = 0; r < rows; r++) {
+		if (capacity - pos < (long long) columns * 130 + 2) {
+			capacity = capacity * 2 + (long long) columns * 130 + 2;
+			d->text = (char *) realloc(d->text, capacity);
+			if (d->text == NULL) {
+				return 1;
+			}
+		}
+		d->row_start[r] = pos;
+		for (c = 0; c < columns; c++) {
+			if (integer) {
+				n = snprintf(field, sizeof(field), format,
+						(int) (lcg() % 65536) - 32768);
+			} else {
+				n = snprintf(field, sizeof(field), format,
+						((double) lcg() / 0x800000 - 1.0) * 1000.0);
+			}
+			if (c) {
+				d->text[pos++] = separator;
+			}
+			memcpy(d->text + pos, field, n);
+			pos += n;
+		}
+		d->row_len[r] = pos - d->row_start[r];
+		d->text[pos++] = '\n';
+	}
+	d->textsize = pos;
+
+	/* a format such as "%.4f" in double quotes tests the quoted kernels */
+	if (memchr(d->text, '"', d->textsize) != NULL) {
+		d->tpl.quoted = 1;
+		select_kernels(&d->tpl, LINES_LF);
+	}
+
+	for (r = 0; r < rows; r++) {
+		parse_row(&d->tpl, d->text + d->row_start[r], d->row_len[r],
+				d->values + (long long) r * d->tpl.edfsignals);
+		tokenize_row(&d->tpl, d->text + d->row_start[r], d->row_len[r],
+				d->field_start + (long long) r * d->tpl.edfsignals);
+	}
+
+	return 0;
+}
+
+static void release(struct bench_data *d) {
+	free(d->text);
+	free(d->row_start);
+	free(d->row_len);
+	free(d->field_start);
+	free(d->values);
+}
+
+/***************** row kernels ******************************************/
+
+static void bench_tokenizer(struct bench_data *d, const char *config) {
+	int i, r, v, field_start[MAX_EDF_SIGNALS];
+	double t, times[repeat], columns = 0;
+	int (*tokenize)(const struct conv_template *, char *, int, int *);
+
+	for (v = 0; v < 2; v++) {
+		tokenize = v ? d->tpl.kernels.tokenize_row : tokenize_row;
+		for (i = 0; i < repeat; i++) {
+			t = now();
+			for (r = 0; r < d->rows; r++) {
+				columns += tokenize(&d->tpl, d->text + d->row_start[r],
+						d->row_len[r], field_start);
+			}
+			times[i] = now() - t;
+		}
+		sink = columns;
+		report(v ? "tokenize/specialized" : "tokenize", config, times,
+				d->textsize, d->rows);
+	}
+}
+
+/*
+ * Row index over the text, against reading it and finding the newlines
+ * with memchr
+ */
+static void bench_index(struct bench_data *d, const char *config) {
+	int i, v;
+	long long rows = 0;
+	size_t n;
+	char *block;
+	const char *p;
+	double t, times[repeat];
+	struct row_index index;
+	FILE *f;
+
+	block = (char *) malloc(1 << 20);
+	for (v = 0; v < 2 && block != NULL; v++) {
+		for (i = 0; i < repeat; i++) {
+			f = fmemopen(d->text, d->textsize, "r");
+			if (f == NULL) {
+				free(block);
+				return;
+			}
+			t = now();
+			if (v) {
+				if (rowindex_build(f, "", 0, &index)) {
+					break;
+				}
+				rows += index.rows;
+				rowindex_free(&index);
+			} else {
+				while ((n = fread(block, 1, 1 << 20, f)) > 0) {
+					for (p = block; (p = (const char *) memchr(p, '\n',
+							block + n - p)) != NULL; p++) {
+						rows++;
+					}
+				}
+			}
+			times[i] = now() - t;
+			fclose(f);
+		}
+		sink = rows;
+		report(v ? "index" : "index/memchr", config, times, d->textsize,
+				d->rows);
+	}
+	free(block);
+}
+
+static void bench_parsers(struct bench_data *d, const char *config) {
+	int i, j, p, r, n = d->tpl.edfsignals, mismatches;
+	const int *fs;
+	const char *row;
+	double t, times[repeat], sum = 0.0, v;
+
+	for (p = 0; p < (int) (sizeof(parsers) / sizeof(parsers[0])); p++) {
+		mismatches = 0;
+		for (r = 0; r < d->rows; r++) {
+			row = d->text + d->row_start[r];
+			fs = d->field_start + (long long) r * n;
+			for (j = 0; j < n; j++) {
+				v = parsers[p].parse(row + fs[j]);
+				if (memcmp(&v, d->values + (long long) r * n + j,
+						sizeof(double))) {
+					mismatches++;
+				}
+			}
+		}
+
+		for (i = 0; i < repeat; i++) {
+			t = now();
+			for (r = 0; r < d->rows; r++) {
+				row = d->text + d->row_start[r];
+				fs = d->field_start + (long long) r * n;
+				for (j = 0; j < n; j++) {
+					sum += parsers[p].parse(row + fs[j]);
+				}
+			}
+			times[i] = now() - t;
+		}
+		sink = sum;
+		report(parsers[p].name, config, times, d->textsize, d->rows);
+		if (mismatches) {
+			printf("%-16s %-22s %d values differ from atof\n",
+					parsers[p].name, config, mismatches);
+		}
+	}
+}
+
+/*
+ * The last row with its fields in double quotes, and then with a separator
+ * inside every pair of quotes, through kernels picked for rows without
+ * quotes, as for a file whose first quote is past the data they were picked
+ * from.  Returns the number of those rows not giving the values of the row.
+ */
+static int late_quotes(struct bench_data *d, const struct conv_template *tpl) {
+	char line[MAX_LINE_LENGTH + 2];
+	const char *p = d->text + d->row_start[d->rows - 1];
+	const int n = tpl->edfsignals, len = d->row_len[d->rows - 1];
+	int i, k, m, mismatches = 0;
+	double value[MAX_EDF_SIGNALS];
+
+	if (tpl->quoted || len + 3 * tpl->columns + 2 > MAX_LINE_LENGTH) {
+		return 0;
+	}
+
+	for (k = 0; k < 2; k++) {
+		for (i = 0, m = 0; i <= len; i++) {
+			if (i == 0 || p[i - 1] == tpl->separator) {
+				line[m++] = '"';
+			}
+			if (i == len || p[i] == tpl->separator) {
+				if (k) {
+					line[m++] = tpl->separator;
+				}
+				line[m++] = '"';
+			}
+			if (i < len) {
+				line[m++] = p[i];
+			}
+		}
+		line[m] = '\n';
+		line[m + 1] = 0;
+
+		mismatches += tpl->kernels.parse_row(tpl, line, m, value)
+				!= tpl->columns || memcmp(value, d->values
+				+ (long long) (d->rows - 1) * n, sizeof(double) * n) != 0;
+	}
+	return mismatches;
+}
+
+/*
+ * Whole rows through parse_row, and through the fixed row or integer kernel
+ * if the rows are fixed or the columns integers.
+ */
+static void bench_rows(struct bench_data *d, const char *config) {
+	int i, r, v, n = d->tpl.edfsignals, mismatches = 0, fixed_rows, integers;
+	int size = d->textsize < 65536 ? (int) d->textsize : 65536;
+	double t, times[repeat], columns = 0, value[MAX_EDF_SIGNALS];
+	struct conv_template *fixed, *tpl;
+
+	fixed = (struct conv_template *) malloc(sizeof(struct conv_template));
+	if (fixed == NULL) {
+		return;
+	}
+	memcpy(fixed, &d->tpl, sizeof(struct conv_template));
+	fixed_rows = fixed_rows_detect(fixed, d->text, size);
+	integers = integer_columns_detect(fixed, d->text, size);
+	select_kernels(fixed, LINES_LF);
+
+	for (v = 0; v <= (fixed_rows || integers); v++) {
+		tpl = v ? fixed : &d->tpl;
+		for (i = 0; i < repeat; i++) {
+			t = now();
+			for (r = 0; r < d->rows; r++) {
+				columns += tpl->kernels.parse_row(tpl, d->text + d->row_start[r],
+						d->row_len[r], value);
+			}
+			times[i] = now() - t;
+		}
+		sink = columns;
+		report(!v ? "parse_row" : fixed_rows ? "parse_row/fixed"
+				: "parse_row/integer", config, times, d->textsize, d->rows);
+
+		for (r = 0; v && r < d->rows; r++) {
+			tpl->kernels.parse_row(tpl, d->text + d->row_start[r],
+					d->row_len[r], value);
+			mismatches += memcmp(value, d->values + (long long) r * n,
+					sizeof(double) * n) != 0;
+		}
+		if (mismatches) {
+			printf("%-24s %-22s %d rows differ from parse_row\n",
+					fixed_rows ? "parse_row/fixed" : "parse_row/integer", config,
+					mismatches);
+		}
+	}
+
+	mismatches = late_quotes(d, &d->tpl) + late_quotes(d, fixed);
+	if (mismatches) {
+		printf("%-24s %-22s %d quoted rows differ from parse_row\n",
+				"parse_row/late_quotes", config, mismatches);
+	}
+	free(fixed);
+}
+
+static void bench_physmax(struct bench_data *d, const char *config) {
+	int i, r, n = d->tpl.edfsignals;
+	double t, times[repeat], maxima[MAX_EDF_SIGNALS];
+
+	for (i = 0; i < repeat; i++) {
+		physmax_reset(maxima);
+		t = now();
+		for (r = 0; r < d->rows; r++) {
+			physmax_update(d->values + (long long) r * n, n, maxima);
+		}
+		times[i] = now() - t;
+	}
+	sink = maxima[0];
+	report("physmax", config, times, d->textsize, d->rows);
+}
+
+/*
+ * The generic and specialized quantize kernels, and the exact one if the
+ * columns hold integers.
+ */
+static void bench_quantize(struct bench_data *d, const char *config,
+		int edf_format) {
+	static const char *names[2][3] = {
+			{ "quantize/bdf", "quantize/bdf/specialized", "quantize/bdf/exact" },
+			{ "quantize/edf", "quantize/edf/specialized", "quantize/edf/exact" } };
+	int i, k, r, v, variants = 2, n = d->tpl.edfsignals, smpls_per_block;
+	double t, times[repeat], maxima[MAX_EDF_SIGNALS], datrecduration;
+	long long clips[MAX_EDF_SIGNALS] = { 0 };
+	char *buf;
+	struct conv_template *exact, *tpl;
+
+	void (*quantize)(const struct conv_template *, const double *, char *,
+			int, int, long long *);
+
+	d->tpl.edf_format = edf_format;
+	select_kernels(&d->tpl, LINES_LF);
+	physmax_reset(maxima);
+	for (r = 0; r < d->rows; r++) {
+		physmax_update(d->values + (long long) r * n, n, maxima);
+	}
+	physmax_finish(&d->tpl, maxima);
+	datarecord_params(d->tpl.samplefrequency, &smpls_per_block,
+			&datrecduration);
+	buf = (char *) calloc(1, datarecord_size(&d->tpl, smpls_per_block));
+	exact = (struct conv_template *) malloc(sizeof(struct conv_template));
+	if (buf == NULL || exact == NULL) {
+		free(buf);
+		free(exact);
+		return;
+	}
+
+	memcpy(exact, &d->tpl, sizeof(struct conv_template));
+	if (integer_columns_detect(exact, d->text,
+			d->textsize < 65536 ? (int) d->textsize : 65536)) {
+		exact->exact_integers = 1;
+		select_quantize_kernel(exact);
+		variants = 3;
+	}
+
+	for (v = 0; v < variants; v++) {
+		tpl = v == 2 ? exact : &d->tpl;
+		quantize = v ? tpl->kernels.quantize_row : quantize_row;
+		for (i = 0; i < repeat; i++) {
+			t = now();
+			for (r = 0, k = 0; r < d->rows; r++) {
+				quantize(tpl, d->values + (long long) r * n, buf, k,
+						smpls_per_block, clips);
+				if (++k >= smpls_per_block) {
+					k = 0;
+				}
+			}
+			times[i] = now() - t;
+		}
+		sink = buf[0];
+		report(names[edf_format][v], config, times, d->textsize, d->rows);
+	}
+	free(buf);
+	free(exact);
+}
+
+static void bench_decimate(struct bench_data *d, const char *config,
+		int factor) {
+	int i, r, n = d->tpl.edfsignals;
+	char name[32];
+	double t, times[repeat], out[MAX_EDF_SIGNALS], sum = 0.0;
+	struct decimator dec;
+
+	for (i = 0; i < repeat; i++) {
+		if (decimator_init(&dec, factor, n)) {
+			return;
+		}
+		t = now();
+		for (r = 0; r < d->rows; r++) {
+			if (decimator_push(&dec, d->values + (long long) r * n, out)) {
+				sum += out[0];
+			}
+		}
+		times[i] = now() - t;
+		decimator_free(&dec);
+	}
+	sink = sum;
+	snprintf(name, sizeof(name), "decimate/%d", factor);
+	report(name, config, times, d->textsize, d->rows);
+}
+
+/***************** header and template **********************************/
+
+static void bench_header(struct bench_data *d, const char *config) {
+	int i, j, loops = 1000;
+	double t, times[repeat];
+	struct edf_header hdr;
+	FILE *outputfile;
+
+	outputfile = fopen("/dev/null", "wb");
+	if (outputfile == NULL) {
+		return;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.patient_name = "Benchmark subject";
+	hdr.recording = "Benchmark recording";
+	hdr.day = hdr.month = 1;
+	datarecord_params(d->tpl.samplefrequency, &hdr.smpls_per_block,
+			&hdr.datrecduration);
+
+	for (i = 0; i < repeat; i++) {
+		t = now();
+		for (j = 0; j < loops; j++) {
+			write_header(outputfile, &d->tpl, &hdr);
+			fflush(outputfile);
+		}
+		times[i] = now() - t;
+	}
+	fclose(outputfile);
+	report("header", config, times,
+			(256.0 * d->tpl.edfsignals + 256.0) * loops, loops);
+}
+
+static int write_template(const char *path, int columns) {
+	int i;
+	FILE *f;
+
+	f = fopen(path, "wb");
+	if (f == NULL) {
+		return 1;
+	}
+	fprintf(f, "<?xml version=\"1.0\"?>\n<EDFbrowser_ascii2edf_template>\n"
+			"  <separator>tab</separator>\n  <columns>%d</columns>\n"
+			"  <startline>1</startline>\n"
+			"  <samplefrequency>256.0000000000</samplefrequency>\n"
+			"  <autophysicalmaximum>1</autophysicalmaximum>\n"
+			"  <edf_format>1</edf_format>\n", columns);
+	for (i = 0; i < columns; i++) {
+		fprintf(f, "  <signalparams>\n    <checked>%d</checked>\n"
+				"    <label>Signal %d</label>\n"
+				"    <physical_maximum>1000</physical_maximum>\n"
+				"    <physical_dimension>uV</physical_dimension>\n"
+				"    <multiplier>1.000000</multiplier>\n  </signalparams>\n",
+				i < MAX_EDF_SIGNALS, i);
+	}
+	fprintf(f, "</EDFbrowser_ascii2edf_template>\n");
+	return fclose(f);
+}
+
+static void bench_template(int columns) {
+	int i, j, loops = columns > 16 ? 20 : 500;
+	char path[] = "/tmp/ascii2edf-bench-XXXXXX", config[32];
+	double t, times[repeat];
+	long size;
+	struct conv_template tpl;
+	FILE *f;
+
+	i = mkstemp(path);
+	if (i < 0) {
+		return;
+	}
+	close(i);
+
+	if (write_template(path, columns)) {
+		unlink(path);
+		return;
+	}
+	f = fopen(path, "rb");
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fclose(f);
+
+	for (i = 0; i < repeat; i++) {
+		t = now();
+		for (j = 0; j < loops; j++) {
+			initSignalTable(&tpl);
+			loadTemplate(path, &tpl);
+		}
+		times[i] = now() - t;
+	}
+	unlink(path);
+	snprintf(config, sizeof(config), "%d columns", columns);
+	report("template", config, times, (double) size * loops, loops);
+}
+
+/***************** main *************************************************/
+
+static int split_list(char *arg, char **items) {
+	int n = 0;
+	char *tok;
+
+	for (tok = strtok(arg, ","); tok && n < MAX_CONFIGS; tok = strtok(NULL, ",")) {
+		items[n++] = tok;
+	}
+	return n;
+}
+
+int main(int argc, char *argv[]) {
+	int i, c, f, ncolumns, nformats, user_formats = 0, rows = 100000,
+			columns[MAX_CONFIGS];
+	char *column_args[MAX_CONFIGS], *formats[MAX_CONFIGS], config[64],
+			separator = '\t';
+	char default_columns[] = "4,32", default_formats[] = "%.4f|%d|%+09.4f";
+	struct bench_data d;
+
+	ncolumns = split_list(default_columns, column_args);
+	nformats = 0;
+	for (formats[0] = strtok(default_formats, "|"); formats[nformats];
+			formats[nformats] = strtok(NULL, "|")) {
+		nformats++;
+	}
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+			ncolumns = split_list(argv[++i], column_args);
+		} else if (!strcmp(argv[i], "-f") && i + 1 < argc
+				&& user_formats < MAX_CONFIGS) {
+			formats[user_formats++] = argv[++i];
+			nformats = user_formats;
+		} else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+			rows = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+			repeat = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+			separator = strcmp(argv[i + 1], "tab") ? argv[i + 1][0] : '\t';
+			i++;
+		} else {
+			printf("ascii2edf kernel benchmarks\n"
+					"Usage: bench [-c columns[,columns...]] [-f format]... [-r rows] [-n runs] [-s separator|tab]\n"
+					"  -c  column counts to test (default 4,32)\n"
+					"  -f  printf format of the values, e.g. %%.4f, %%d or \"%%.4f\", may be repeated\n"
+					"      (default %%.4f, %%d and %%+09.4f)\n"
+					"  -r  rows of csv data per test (default 100000)\n"
+					"  -n  runs per benchmark, the median is reported (default 5)\n"
+					"  -s  separator (default tab)\n");
+			return 1;
+		}
+	}
+
+	for (c = 0; c < ncolumns; c++) {
+		columns[c] = atoi(column_args[c]);
+		if (columns[c] < 1 || columns[c] > MAX_COLUMNS) {
+			printf("Column count must be between 1 and %d\n", MAX_COLUMNS);
+			return 1;
+		}
+	}
+	if (rows < 1 || repeat < 1) {
+		printf("Rows and runs must be positive\n");
+		return 1;
+	}
+
+	for (c = 0; c < ncolumns; c++) {
+		for (f = 0; f < nformats; f++) {
+			if (generate(&d, rows, columns[c], formats[f], separator)) {
+				printf("Malloc error\n");
+				return 1;
+			}
+			snprintf(config, sizeof(config), "%dx%s", columns[c], formats[f]);
+
+			bench_tokenizer(&d, config);
+			bench_index(&d, config);
+			bench_parsers(&d, config);
+			bench_rows(&d, config);
+			bench_physmax(&d, config);
+			bench_quantize(&d, config, 1);
+			bench_quantize(&d, config, 0);
+			bench_decimate(&d, config, 8);
+			release(&d);
+		}
+
+		setup_template(&d.tpl, columns[c], separator, 1);
+		physmax_manual(&d.tpl);
+		snprintf(config, sizeof(config), "%d signals", d.tpl.edfsignals);
+		bench_header(&d, config);
+	}
+
+	bench_template(4);
+	bench_template(MAX_COLUMNS);
+
+	return 0;
+}
@@ -0,0 +1,248 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Checkpoint files.  A checkpoint is only written once the outputs hold
+ * everything it describes, and it replaces the previous one atomically, so
+ * whenever the process dies there is a consistent checkpoint on disk.  The
+ * file is in the byte order of the machine that wrote it.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#include "checkpoint.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define CHECKPOINT_MAGIC "A2ECKPT3"
+#define CHECKPOINT_END "END\n"
+
+/* Makes the data written to a file durable */
+static int sync_file(const char *path) {
+	int fd = open(path, O_RDONLY), error;
+
+	if (fd < 0) {
+		return 1;
+	}
+	error = fdatasync(fd);
+	close(fd);
+
+	return error != 0;
+}
+
+static void put(FILE *f, const void *p, size_t size) {
+	if (size > 0) {
+		fwrite(p, size, 1, f);
+	}
+}
+
+static int get(FILE *f, void *p, size_t size) {
+	return size > 0 && fread(p, size, 1, f) != 1;
+}
+
+/*
+ * Flushes the outputs and saves the state in ck->path.  Returns 0 on
+ * success.
+ */
+int checkpoint_write(struct checkpoint *ck) {
+	char tmp[MAX_PATH_LENGTH + 8];
+	struct checkpoint_output *o;
+	struct decimator *dec = ck->dec;
+	FILE *f;
+	int i, error, has_stats, has_hash;
+
+	for (i = 0; i < ck->noutputs; i++) {
+		o = &ck->outputs[i];
+		/* the seek makes sure buffered writes have reached the file */
+		if (fflush(o->file) || fseek(o->file, 0, SEEK_END)
+				|| sync_file(o->filename)) {
+			printf("Error: Can not flush %s for a checkpoint", o->filename);
+			return 1;
+		}
+		o->size = ftell(o->file);
+	}
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", ck->path);
+	f = fopen(tmp, "wb");
+	if (f == NULL) {
+		printf("Can not open file %s for writing.", tmp);
+		return 1;
+	}
+
+	put(f, CHECKPOINT_MAGIC, 8);
+	put(f, &ck->input_size, sizeof(ck->input_size));
+	put(f, &ck->input_mtime, sizeof(ck->input_mtime));
+	put(f, &ck->smpls_per_block, sizeof(ck->smpls_per_block));
+	put(f, &ck->decimate, sizeof(ck->decimate));
+	put(f, &ck->noutputs, sizeof(ck->noutputs));
+	put(f, &ck->offset, sizeof(ck->offset));
+	put(f, &ck->row, sizeof(ck->row));
+
+	for (i = 0; i < ck->noutputs; i++) {
+		o = &ck->outputs[i];
+		put(f, &o->size, sizeof(o->size));
+		put(f, &o->datarecords, sizeof(o->datarecords));
+		put(f, &o->k, sizeof(o->k));
+		put(f, &o->bufsize, sizeof(o->bufsize));
+		put(f, &o->nsignals, sizeof(o->nsignals));
+		put(f, o->buf, o->bufsize);
+		put(f, o->sigphysmax, sizeof(double) * o->nsignals);
+		put(f, o->sensitivity, sizeof(double) * o->nsignals);
+		put(f, o->clips, sizeof(long long) * o->nsignals);
+		has_stats = o->sigstats != NULL;
+		put(f, &has_stats, sizeof(has_stats));
+		if (has_stats) {
+			put(f, o->sigstats, sizeof(struct signal_stats));
+		}
+		has_hash = o->hash != NULL;
+		put(f, &has_hash, sizeof(has_hash));
+		if (has_hash) {
+			put(f, o->hash, sizeof(struct output_hash));
+		}
+	}
+
+	if (dec != NULL) {
+		put(f, &dec->taps, sizeof(dec->taps));
+		put(f, &dec->nsignals, sizeof(dec->nsignals));
+		put(f, &dec->pos, sizeof(dec->pos));
+		put(f, &dec->pushed, sizeof(dec->pushed));
+		put(f, &dec->inputs, sizeof(dec->inputs));
+		put(f, &dec->next_center, sizeof(dec->next_center));
+		put(f, dec->history, sizeof(double) * 2 * dec->taps * dec->nsignals);
+		put(f, dec->last, sizeof(double) * dec->nsignals);
+	}
+
+	put(f, CHECKPOINT_END, 4);
+
+	error = fflush(f) || ferror(f) || fsync(fileno(f));
+	error |= fclose(f) != 0;
+	if (error || rename(tmp, ck->path)) {
+		printf("Error: Can not write checkpoint %s", ck->path);
+		unlink(tmp);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Restores the state saved in ck->path.  The identifying fields of ck, the
+ * sizes and the pointers must be set up as for the interrupted conversion.
+ * Returns 0 on success.
+ */
+int checkpoint_read(struct checkpoint *ck) {
+	char magic[8];
+	long long input_size, input_mtime;
+	int i, smpls_per_block, decimate, noutputs, bufsize, nsignals, taps,
+			has_stats, has_hash, error = 0;
+	struct checkpoint_output *o;
+	struct decimator *dec = ck->dec;
+	FILE *f;
+
+	f = fopen(ck->path, "rb");
+	if (f == NULL) {
+		printf("Can not open checkpoint %s", ck->path);
+		return 1;
+	}
+
+	if (get(f, magic, 8) || memcmp(magic, CHECKPOINT_MAGIC, 8)
+			|| get(f, &input_size, sizeof(input_size))
+			|| get(f, &input_mtime, sizeof(input_mtime))
+			|| get(f, &smpls_per_block, sizeof(smpls_per_block))
+			|| get(f, &decimate, sizeof(decimate))
+			|| get(f, &noutputs, sizeof(noutputs))
+			|| get(f, &ck->offset, sizeof(ck->offset))
+			|| get(f, &ck->row, sizeof(ck->row))) {
+		error = 1;
+	} else if (input_size != ck->input_size || input_mtime != ck->input_mtime
+			|| smpls_per_block != ck->smpls_per_block
+			|| decimate != ck->decimate || noutputs != ck->noutputs) {
+		error = 2;
+	}
+
+	for (i = 0; i < ck->noutputs && !error; i++) {
+		o = &ck->outputs[i];
+		if (get(f, &o->size, sizeof(o->size))
+				|| get(f, &o->datarecords, sizeof(o->datarecords))
+				|| get(f, &o->k, sizeof(o->k))
+				|| get(f, &bufsize, sizeof(bufsize))
+				|| get(f, &nsignals, sizeof(nsignals))) {
+			error = 1;
+		} else if (bufsize != o->bufsize || nsignals != o->nsignals
+				|| o->k < 0 || o->k >= smpls_per_block) {
+			error = 2;
+		} else if (get(f, o->buf, o->bufsize)
+				|| get(f, o->sigphysmax, sizeof(double) * o->nsignals)
+				|| get(f, o->sensitivity, sizeof(double) * o->nsignals)
+				|| get(f, o->clips, sizeof(long long) * o->nsignals)
+				|| get(f, &has_stats, sizeof(has_stats))) {
+			error = 1;
+		} else if (has_stats != (o->sigstats != NULL)) {
+			error = 2;
+		} else if ((has_stats
+				&& get(f, o->sigstats, sizeof(struct signal_stats)))
+				|| get(f, &has_hash, sizeof(has_hash))) {
+			error = 1;
+		} else if (has_hash != (o->hash != NULL)) {
+			error = 2;
+		} else if (has_hash && get(f, o->hash, sizeof(struct output_hash))) {
+			error = 1;
+		}
+	}
+
+	if (dec != NULL && !error) {
+		if (get(f, &taps, sizeof(taps))
+				|| get(f, &nsignals, sizeof(nsignals))) {
+			error = 1;
+		} else if (taps != dec->taps || nsignals != dec->nsignals) {
+			error = 2;
+		} else if (get(f, &dec->pos, sizeof(dec->pos))
+				|| get(f, &dec->pushed, sizeof(dec->pushed))
+				|| get(f, &dec->inputs, sizeof(dec->inputs))
+				|| get(f, &dec->next_center, sizeof(dec->next_center))
+				|| get(f, dec->history,
+						sizeof(double) * 2 * dec->taps * dec->nsignals)
+				|| get(f, dec->last, sizeof(double) * dec->nsignals)) {
+			error = 1;
+		}
+	}
+
+	if (!error && (get(f, magic, 4) || memcmp(magic, CHECKPOINT_END, 4))) {
+		error = 1;
+	}
+
+	fclose(f);
+
+	if (error == 1) {
+		printf("Error: Checkpoint %s is damaged", ck->path);
+	} else if (error == 2) {
+		printf("Error: Checkpoint %s is for a different conversion", ck->path);
+	}
+
+	return error != 0;
+}
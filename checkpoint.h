@@ -0,0 +1,84 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Checkpoints of a running conversion, so that --resume can continue it
+ * after the process died instead of starting over.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#ifndef checkpoint_INCLUDED
+#define checkpoint_INCLUDED
+
+#include "convert.h"
+#include "decimate.h"
+#include "hash.h"
+#include "stats.h"
+#include <stdio.h>
+
+/* Default seconds between checkpoints */
+#define CHECKPOINT_INTERVAL 60
+
+/*
+ * State of one output file.  The pointers refer to the live conversion:
+ * checkpoint_write() saves what they point to, checkpoint_read() restores it.
+ */
+struct checkpoint_output {
+	const char *filename;
+	FILE *file;
+	long long size; /* bytes of the file the checkpoint covers */
+	int datarecords;
+	int k; /* samples in the partial datarecord */
+	int bufsize;
+	char *buf; /* the partial datarecord */
+	int nsignals;
+	double *sigphysmax;
+	double *sensitivity;
+	long long *clips;
+	struct signal_stats *sigstats; /* NULL if not kept */
+	struct output_hash *hash; /* NULL if not kept */
+};
+
+struct checkpoint {
+	char path[MAX_PATH_LENGTH];
+	int interval; /* seconds between checkpoints */
+	long long input_size; /* the csv file must not change in between */
+	long long input_mtime;
+	int smpls_per_block;
+	int decimate;
+	long long offset; /* of the next row, headersize excluded */
+	long long row; /* rows converted */
+	int noutputs;
+	struct checkpoint_output *outputs;
+	struct decimator *dec; /* NULL if not decimating */
+};
+
+int checkpoint_write(struct checkpoint *ck);
+int checkpoint_read(struct checkpoint *ck);
+
+#endif
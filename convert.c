@@ -0,0 +1,1643 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Template handling and the per-row kernels of the ascii to EDF
+ * converter, shared by ascii2edf and the benchmark driver.
+ *
+ * This work is an adaptation of
+ * EDFbrowser by Teunis van Beelen (teuniz@gmail.com)
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#include "convert.h"
+#include "xml.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/***************** row kernels ******************************************/
+
+/*
+ * The row kernels are templates on what the template fixes for the whole
+ * file: line ending, separator, decimal style and output format.
+ * select_kernels() picks the instantiation once, so the per byte and per
+ * sample loops test none of these.  Separator 0 is the generic kernel,
+ * which reads the separator from the template.
+ */
+
+/*
+ * Reads one line of csv data into line.  With Crlf every carriage return
+ * is dropped, otherwise only one just before the newline.  The line is
+ * terminated with '\n' and a null byte.  Returns the number of characters
+ * before the newline, ROW_EOF when the file ends before a newline or
+ * ROW_TOO_LONG when the line exceeds MAX_LINE_LENGTH.
+ */
+template<bool Crlf>
+static int read_row_t(const struct conv_template *tpl, FILE *inputfile,
+		char *line) {
+	int i, temp;
+
+	(void) tpl; /* the line ending is in Crlf */
+	for (i = 0;;) {
+		temp = getc_unlocked(inputfile);
+
+		if (temp == EOF) {
+			return ROW_EOF;
+		}
+
+		if (Crlf && temp == '\r') {
+			continue;
+		}
+
+		line[i] = temp;
+
+		if (temp == '\n') {
+			if (!Crlf && i > 0 && line[i - 1] == '\r') {
+				line[--i] = '\n';
+			}
+			line[i + 1] = 0;
+			return i;
+		}
+
+		i++;
+
+		if (i > MAX_LINE_LENGTH) {
+			return ROW_TOO_LONG;
+		}
+	}
+}
+
+/*
+ * Splits a line read by read_row() into columns.  Empty fields are skipped,
+ * the way EDFbrowser does.  With DecimalComma, decimal commas are rewritten
+ * to points in place.  The start offsets of the fields of enabled columns
+ * are stored in field_start.  Returns the number of columns.
+ */
+template<char Sep, bool DecimalComma>
+static int tokenize_row_t(const struct conv_template *tpl, char *line,
+		int len, int *field_start) {
+	int i, column = 0, edf_signal = 0;
+	const char separator = Sep ? Sep : tpl->separator;
+
+	for (i = 0; i < len; i++) {
+		if (DecimalComma && line[i] == ',') {
+			line[i] = '.';
+		}
+
+		if (line[i] == separator) {
+			continue;
+		}
+
+		/* first character of a field, scan on to its end */
+		if (column < MAX_COLUMNS && tpl->column_enabled[column]) {
+			if (edf_signal < MAX_EDF_SIGNALS) {
+				field_start[edf_signal] = i;
+			}
+			edf_signal++;
+		}
+		column++;
+
+		for (i++; i < len; i++) {
+			if (DecimalComma && line[i] == ',') {
+				line[i] = '.';
+			}
+
+			if (line[i] == separator) {
+				break;
+			}
+		}
+	}
+
+	return column;
+}
+
+/* Bit i is set if p[i] is c, for p[0, 64) */
+static inline unsigned long long byte_mask(const char *p, char c) {
+	unsigned long long mask = 0;
+	int i;
+#if defined(__SSE2__)
+	const __m128i v = _mm_set1_epi8(c);
+
+	for (i = 0; i < 4; i++) {
+		mask |= (unsigned long long) (unsigned int) _mm_movemask_epi8(
+				_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (p + 16 * i)),
+						v)) << (16 * i);
+	}
+#else
+	for (i = 0; i < 64; i++) {
+		mask |= (unsigned long long) (p[i] == c) << i;
+	}
+#endif
+	return mask;
+}
+
+/* Bit i is the xor of bits 0 to i: set from an opening quote on */
+static inline unsigned long long prefix_xor(unsigned long long mask) {
+	mask ^= mask << 1;
+	mask ^= mask << 2;
+	mask ^= mask << 4;
+	mask ^= mask << 8;
+	mask ^= mask << 16;
+	mask ^= mask << 32;
+	return mask;
+}
+
+/*
+ * tokenize_row_t() for rows with fields in double quotes, as in RFC 4180:
+ * separators between quotes are part of the field, and "" is a quote in a
+ * quoted field.  The line is looked at 64 bytes at a time as bit masks of
+ * its quotes and separators; the prefix xor of the quotes marks the bytes
+ * inside quotes, whose separators are dropped from the mask, and the field
+ * starts and ends are the edges of the remaining separators.  A converted
+ * field that starts with a quote starts after it, and the number ends at
+ * the closing quote.  Quoted fields do not hold newlines.
+ */
+template<char Sep, bool DecimalComma>
+static int tokenize_quoted_row_t(const struct conv_template *tpl, char *line,
+		int len, int *field_start) {
+	const char separator = Sep ? Sep : tpl->separator;
+	unsigned long long inside = 0, seps, edges, commas, last = 1;
+	char block[64];
+	const char *p;
+	int i, k, column = 0, edf_signal = 0, open = 0;
+
+	for (i = 0; i < len; i += 64) {
+		p = line + i;
+		if (len - i < 64) {
+			memset(block, separator, sizeof(block));
+			memcpy(block, p, len - i);
+			p = block;
+		}
+
+		/* carry the quote state of the previous block */
+		inside = prefix_xor(byte_mask(p, '"')) ^ (0 - (inside >> 63));
+		seps = byte_mask(p, separator) & ~inside;
+		if (len - i < 64) {
+			seps |= ~0ULL << (len - i);
+		}
+
+		if (DecimalComma) {
+			for (commas = byte_mask(p, ',') & ~seps; commas;
+					commas &= commas - 1) {
+				line[i + __builtin_ctzll(commas)] = '.';
+			}
+		}
+
+		/* a field starts after a separator and ends at the next one */
+		edges = seps ^ ((seps << 1) | last);
+		last = seps >> 63;
+		for (; edges; edges &= edges - 1, open = !open) {
+			if (open) {
+				continue;
+			}
+			k = i + __builtin_ctzll(edges);
+			if (column < MAX_COLUMNS && tpl->column_enabled[column]) {
+				if (edf_signal < MAX_EDF_SIGNALS) {
+					field_start[edf_signal] = k + (line[k] == '"');
+				}
+				edf_signal++;
+			}
+			column++;
+		}
+	}
+
+	return column;
+}
+
+/*
+ * Converts the integer field at p of a line ending at end, where the newline
+ * is: spaces, a sign and at most 15 digits, followed by a separator, the
+ * newline or the quote closing a quoted field.  The digits are decoded 8 at
+ * a time in a 64 bit word; the value is exactly what atof() returns.
+ * Returns 1 if the field is something else.
+ */
+template<char Sep>
+static inline int parse_integer(const struct conv_template *tpl,
+		const char *p, const char *end, double *value) {
+	static const unsigned long long pow10[] = { 1ULL, 10ULL, 100ULL, 1000ULL,
+			10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL };
+	const char separator = Sep ? Sep : tpl->separator;
+	unsigned long long n = 0;
+	int k, digits = 0, negative;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	unsigned long long t, nondigit;
+#endif
+
+	while (*p == ' ') {
+		p++;
+	}
+	negative = *p == '-';
+	if (*p == '-' || *p == '+') {
+		p++;
+	}
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	/* the newline is the last byte the word may hold */
+	for (k = 8; k == 8 && p + 8 <= end + 1; p += k, digits += k) {
+		memcpy(&t, p, 8);
+		t ^= 0x3030303030303030ULL;
+		nondigit = (((t & 0x7f7f7f7f7f7f7f7fULL) + 0x7676767676767676ULL) | t)
+				& 0x8080808080808080ULL;
+		k = nondigit ? __builtin_ctzll(nondigit) >> 3 : 8;
+		if (k == 0) {
+			break;
+		}
+
+		/* the digits to the top, then pairs, fours and all eight combined */
+		t <<= 8 * (8 - k);
+		t = t * 10 + (t >> 8);
+		t = (((t & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32)))
+				+ (((t >> 16) & 0x000000ff000000ffULL)
+						* (1 + (10000ULL << 32)))) >> 32;
+		n = n * pow10[k] + t;
+	}
+#endif
+	for (; *p >= '0' && *p <= '9'; p++, digits++) {
+		n = n * 10 + (*p - '0');
+	}
+
+	if (digits == 0 || digits > 15
+			|| (p != end && *p != separator && *p != '"')) {
+		return 1;
+	}
+
+	*value = negative ? -(double) n : (double) n;
+	return 0;
+}
+
+/*
+ * Tokenizes a line and converts the fields of the enabled columns to values.
+ * With Integer, the fields of integer columns are decoded as integers first.
+ * With Quoted, fields may be in double quotes.  Without, a row found to
+ * have quotes after all, by a wrong number of columns or a converted field
+ * starting with one, is tokenized again as with Quoted; other rows pay
+ * nothing for it.  Returns the number of columns; the values are only
+ * meaningful if that matches the template.
+ */
+template<char Sep, bool DecimalComma, bool Integer, bool Quoted>
+static int parse_row_t(const struct conv_template *tpl, char *line, int len,
+		double *value) {
+	int j, column, field_start[MAX_EDF_SIGNALS];
+
+	column = Quoted
+			? tokenize_quoted_row_t<Sep, DecimalComma>(tpl, line, len,
+					field_start)
+			: tokenize_row_t<Sep, DecimalComma>(tpl, line, len, field_start);
+	if (column != tpl->columns) {
+		if (!Quoted && memchr(line, '"', len) != NULL) {
+			return parse_row_t<Sep, DecimalComma, Integer, true>(tpl, line, len,
+					value);
+		}
+		return column;
+	}
+
+	for (j = 0; j < tpl->edfsignals; j++) {
+		if (!Integer || !tpl->integer[j] || parse_integer<Sep>(tpl,
+				line + field_start[j], line + len, &value[j])) {
+			if (!Quoted && line[field_start[j]] == '"') {
+				return parse_row_t<Sep, DecimalComma, Integer, true>(tpl, line,
+						len, value);
+			}
+			value[j] = atof(line + field_start[j]);
+		}
+	}
+
+	return column;
+}
+
+/*
+ * read_row_t<false>() for fixed rows: reads a row of the usual size at once
+ * and only looks for a newline at its end and nowhere before.  Anything else
+ * is read again the usual way.
+ */
+static int read_fixed_row(const struct conv_template *tpl, FILE *inputfile,
+		char *line) {
+	const int bytes = tpl->fixed.bytes;
+	int len = bytes - 1;
+	size_t n;
+
+	n = fread(line, 1, bytes, inputfile);
+	if (n == (size_t) bytes && line[len] == '\n'
+			&& memchr(line, '\n', len) == NULL) {
+		if (len > 0 && line[len - 1] == '\r') {
+			line[--len] = '\n';
+		}
+		line[len + 1] = 0;
+		return len;
+	}
+
+	if (n > 0) {
+		fseek(inputfile, -(long) n, SEEK_CUR);
+	}
+	return read_row_t<false>(tpl, inputfile, line);
+}
+
+/*
+ * Decodes a field laid out as in the fixed rows: spaces, a sign, digits and
+ * a decimal point at point.  The digits make one integer which is divided
+ * by scale; for up to 15 digits that rounds exactly like atof().  Returns 1
+ * if the field has another form.
+ */
+template<bool DecimalComma>
+static inline int fixed_field(const char *p, int point, int len,
+		double scale, double *value) {
+	unsigned long long n = 0;
+	unsigned int d;
+	int i = 0, bad, negative;
+
+	while (i < point && p[i] == ' ') {
+		i++;
+	}
+	negative = i < point && p[i] == '-';
+	if (i < point && (p[i] == '-' || p[i] == '+')) {
+		i++;
+	}
+	bad = i == point && point + 1 >= len;
+
+	for (; i < point; i++) {
+		d = (unsigned char) p[i] - '0';
+		bad |= d > 9;
+		n = n * 10 + d;
+	}
+	if (point < len) {
+		bad |= p[point] != '.' && !(DecimalComma && p[point] == ',');
+		for (i = point + 1; i < len; i++) {
+			d = (unsigned char) p[i] - '0';
+			bad |= d > 9;
+			n = n * 10 + d;
+		}
+	}
+
+	*value = negative ? -(n / scale) : n / scale;
+	return bad;
+}
+
+/*
+ * Converts a row laid out as in tpl->fixed.  Returns 1 if any field or
+ * separator is out of place, and the row must be tokenized.
+ */
+template<char Sep, bool DecimalComma>
+static int parse_fixed_fields(const struct conv_template *tpl,
+		const char *line, double *value) {
+	const struct fixed_rows *f = &tpl->fixed;
+	const char separator = Sep ? Sep : tpl->separator;
+	int i, j, k, bad = 0;
+
+	for (i = 0; i < f->ngaps; i++) {
+		for (k = f->gap_start[i]; k < f->gap_end[i]; k++) {
+			bad |= line[k] != separator;
+		}
+	}
+
+	for (i = 0; i < f->nskipped; i++) {
+		for (k = f->skipped_start[i]; k < f->skipped_end[i]; k++) {
+			bad |= line[k] == separator;
+		}
+	}
+
+	for (j = 0; j < tpl->edfsignals; j++) {
+		bad |= fixed_field<DecimalComma>(line + f->start[j],
+				f->point[j] - f->start[j], f->end[j] - f->start[j], f->scale[j],
+				&value[j]);
+	}
+
+	return bad;
+}
+
+/* parse_row_t() for templates with fixed rows */
+template<char Sep, bool DecimalComma, bool Integer>
+static int parse_fixed_row_t(const struct conv_template *tpl, char *line,
+		int len, double *value) {
+	if (len == tpl->fixed.length
+			&& !parse_fixed_fields<Sep, DecimalComma>(tpl, line, value)) {
+		return tpl->columns;
+	}
+
+	return parse_row_t<Sep, DecimalComma, Integer, false>(tpl, line, len,
+			value);
+}
+
+/*
+ * value * sensitivity of signal j rounded to the nearest integer, halves
+ * away from zero, and limited to two past limit either way.  The double
+ * product is within 2^-28 of the exact one below limit, so it rounds the
+ * same unless it is that close to a half.  Then the product of an integral
+ * value is computed exactly, see exact_scaling().
+ */
+static inline int exact_sample(const struct conv_template *tpl, int j,
+		double value, int limit) {
+	const double big = 9007199254740992.0; /* 2^53 */
+	const long long m = tpl->exact_mantissa[j];
+	const int shift = tpl->exact_shift[j];
+	double x = value * tpl->sensitivity[j], f;
+	long long n;
+	unsigned __int128 p;
+	int t;
+
+	if (!(fabs(x) < limit + 3.0)) {
+		return x > 0.0 ? limit + 2 : -limit - 2;
+	}
+	t = (int) x;
+	f = x - t;
+
+	if (fabs(fabs(f) - 0.5) >= 0x1p-28 || !(value > -big && value < big)
+			|| (double) (n = (long long) value) != value) {
+		return t + (f >= 0.5) - (f <= -0.5);
+	}
+
+	p = (unsigned __int128) (unsigned long long) (n < 0 ? -n : n)
+			* (unsigned long long) (m < 0 ? -m : m);
+	if (p == 0 || shift > 127) {
+		p = 0;
+	} else if (shift <= 0) {
+		p = limit + 2;
+	} else {
+		p = (p + ((unsigned __int128) 1 << (shift - 1))) >> shift;
+	}
+	if (p > (unsigned __int128) limit + 2) {
+		p = limit + 2;
+	}
+	return (n < 0) != (m < 0) ? -(int) p : (int) p;
+}
+
+/*
+ * Converts the values of one csv row to digital samples and stores them as
+ * sample k of every signal in the datarecord buffer.  Samples that saturate
+ * are counted per signal in clips.  With Exact, the signals of integer
+ * columns are scaled by exact_sample().
+ */
+template<bool Edf, bool Exact>
+static void quantize_row_t(const struct conv_template *tpl,
+		const double *value, char *buf, int k, int smpls_per_block,
+		long long *clips) {
+	const int digmax = Edf ? 32767 : 8388607, digmin = -digmax - 1;
+	int j, p, temp;
+
+	for (j = 0; j < tpl->edfsignals; j++) {
+		if (Exact && tpl->integer[j]) {
+			temp = exact_sample(tpl, j, value[j], digmax);
+		} else {
+			temp = (int) (value[j] * tpl->sensitivity[j]);
+		}
+
+		if (temp > digmax) {
+			temp = digmax;
+			clips[j]++;
+		}
+
+		if (temp < digmin) {
+			temp = digmin;
+			clips[j]++;
+		}
+
+		if (Edf) {
+			*(((short *) buf) + k + (j * smpls_per_block)) = (short) temp;
+		} else {
+			p = (k + (j * smpls_per_block)) * 3;
+
+			buf[p++] = temp & 0xff;
+			buf[p++] = (temp >> 8) & 0xff;
+			buf[p] = (temp >> 16) & 0xff;
+		}
+	}
+}
+
+/*
+ * Binary rows hold a sample of every column, all of one type, so a row is
+ * read whole and the converted columns are picked out of it.
+ */
+static int read_binary_row(const struct conv_template *tpl, FILE *inputfile,
+		char *line) {
+	const size_t bytes = binary_row_size(tpl);
+
+	return fread(line, 1, bytes, inputfile) == bytes ? (int) bytes : ROW_EOF;
+}
+
+static int tokenize_binary_row(const struct conv_template *tpl, char *line,
+		int len, int *field_start) {
+	const int size = binary_row_size(tpl) / tpl->columns;
+	int j;
+
+	/* the fields are at fixed places, whatever the row holds */
+	(void) line;
+	(void) len;
+
+	for (j = 0; j < tpl->edfsignals; j++) {
+		field_start[j] = tpl->sigcolumn[j] * size;
+	}
+	return tpl->columns;
+}
+
+template<int Type, bool Swap>
+static inline double binary_sample(const char *p) {
+	unsigned short u16;
+	unsigned int u32;
+	unsigned long long u64;
+	float f;
+	double d;
+
+	switch (Type) {
+	case BINARY_INT16:
+		memcpy(&u16, p, 2);
+		if (Swap) {
+			u16 = __builtin_bswap16(u16);
+		}
+		return (short) u16;
+	case BINARY_INT32:
+	case BINARY_FLOAT32:
+		memcpy(&u32, p, 4);
+		if (Swap) {
+			u32 = __builtin_bswap32(u32);
+		}
+		if (Type == BINARY_INT32) {
+			return (int) u32;
+		}
+		memcpy(&f, &u32, 4);
+		return f;
+	default:
+		memcpy(&u64, p, 8);
+		if (Swap) {
+			u64 = __builtin_bswap64(u64);
+		}
+		memcpy(&d, &u64, 8);
+		return d;
+	}
+}
+
+template<int Type, bool Swap>
+static int parse_binary_row_t(const struct conv_template *tpl, char *line,
+		int len, double *value) {
+	const int size = Type == BINARY_INT16 ? 2 : Type == BINARY_FLOAT64 ? 8 : 4;
+	int j;
+
+	(void) len; /* rows are always binary_row_size() long */
+
+	for (j = 0; j < tpl->edfsignals; j++) {
+		value[j] = binary_sample<Type, Swap>(line + tpl->sigcolumn[j] * size);
+	}
+	return tpl->columns;
+}
+
+template<int Type>
+static void select_binary_kernels(struct conv_kernels *kernels,
+		int big_endian) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	big_endian = !big_endian;
+#endif
+	kernels->parse_row = big_endian ? parse_binary_row_t<Type, true>
+			: parse_binary_row_t<Type, false>;
+}
+
+template<char Sep, bool DecimalComma>
+static void select_row_kernels(struct conv_kernels *kernels, int fixed,
+		int integer, int quoted) {
+	if (quoted) {
+		kernels->tokenize_row = tokenize_quoted_row_t<Sep, DecimalComma>;
+		kernels->parse_row = integer
+				? parse_row_t<Sep, DecimalComma, true, true>
+				: parse_row_t<Sep, DecimalComma, false, true>;
+		return;
+	}
+
+	kernels->tokenize_row = tokenize_row_t<Sep, DecimalComma>;
+	if (integer) {
+		kernels->parse_row = fixed ? parse_fixed_row_t<Sep, DecimalComma, true>
+				: parse_row_t<Sep, DecimalComma, true, false>;
+	} else {
+		kernels->parse_row = fixed ? parse_fixed_row_t<Sep, DecimalComma, false>
+				: parse_row_t<Sep, DecimalComma, false, false>;
+	}
+}
+
+/*
+ * Finds out whether the rows at the start of the data, text[0, n), are
+ * fixed rows: all of one length, with every converted field holding at most
+ * 15 digits and its decimal point in the same place.  Sets tpl->fixed, for
+ * select_kernels().  Returns 1 if they are.
+ */
+int fixed_rows_detect(struct conv_template *tpl, const char *text, int n) {
+	static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+			1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+	struct fixed_rows *f = &tpl->fixed;
+	const char separator = tpl->separator, *row, *eol, *c;
+	int i, j, column, start, rows, len, decimals;
+	double value[MAX_EDF_SIGNALS];
+
+	memset(f, 0, sizeof(struct fixed_rows));
+
+	/* characters of a field must never be taken for a separator */
+	if (tpl->quoted || (separator >= '0' && separator <= '9') || separator == '+'
+			|| separator == '-' || separator == '.') {
+		return 0;
+	}
+
+	eol = (const char *) memchr(text, '\n', n);
+	if (eol == NULL || eol - text > MAX_LINE_LENGTH) {
+		return 0;
+	}
+	len = eol - text;
+	if (len > 0 && text[len - 1] == '\r') {
+		len--;
+	}
+
+	for (i = 0, j = 0, column = 0; i < len; column++) {
+		start = i;
+		while (i < len && text[i] == separator) {
+			i++;
+		}
+		if (i > start) {
+			f->gap_start[f->ngaps] = start;
+			f->gap_end[f->ngaps++] = i;
+		}
+		if (i == len) {
+			break;
+		}
+		if (column == tpl->columns) {
+			return 0;
+		}
+
+		start = i;
+		while (i < len && text[i] != separator) {
+			i++;
+		}
+
+		if (!tpl->column_enabled[column]) {
+			f->skipped_start[f->nskipped] = start;
+			f->skipped_end[f->nskipped++] = i;
+			continue;
+		}
+
+		f->start[j] = start;
+		f->point[j] = i;
+		for (c = text + start; c < text + i; c++) {
+			if (*c == '.' || (separator != ',' && *c == ',')) {
+				f->point[j] = c - text;
+				break;
+			}
+		}
+		decimals = f->point[j] < i ? i - f->point[j] - 1 : 0;
+		if (i - start - (f->point[j] < i) > 15) {
+			return 0;
+		}
+		f->end[j] = i;
+		f->scale[j++] = pow10[decimals];
+	}
+
+	if (column != tpl->columns) {
+		return 0;
+	}
+
+	f->length = len;
+	f->bytes = eol - text + 1;
+
+	/* the first rows must all check out */
+	for (rows = 0, row = text; rows < 16 && row + f->bytes <= text + n;
+			rows++, row += f->bytes) {
+		if (row[f->bytes - 1] != '\n' || row[len] != text[len]
+				|| memchr(row, '\n', f->bytes - 1) != NULL
+				|| (separator == ','
+						? parse_fixed_fields<0, false>(tpl, row, value)
+						: parse_fixed_fields<0, true>(tpl, row, value))) {
+			f->length = 0;
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * Finds the converted columns which hold integers in all of the first 16
+ * rows of text[0, n), the start of the data, and sets tpl->integer for
+ * them.  Returns the number of such columns.
+ */
+int integer_columns_detect(struct conv_template *tpl, const char *text,
+		int n) {
+	char line[MAX_LINE_LENGTH + 2];
+	const char *p, *eol;
+	int j, len, rows, found = 0, field_start[MAX_EDF_SIGNALS];
+	double value;
+
+	for (j = 0; j < tpl->edfsignals; j++) {
+		tpl->integer[j] = 1;
+	}
+
+	for (rows = 0, p = text; rows < 16; rows++, p = eol + 1) {
+		eol = (const char *) memchr(p, '\n', text + n - p);
+		if (eol == NULL) {
+			break;
+		}
+		len = eol - p;
+		if (len > 0 && p[len - 1] == '\r') {
+			len--;
+		}
+		if (len > MAX_LINE_LENGTH) {
+			rows = 0;
+			break;
+		}
+
+		memcpy(line, p, len);
+		line[len] = '\n';
+		line[len + 1] = 0;
+		if (tokenize_row(tpl, line, len, field_start) != tpl->columns) {
+			rows = 0;
+			break;
+		}
+
+		for (j = 0; j < tpl->edfsignals; j++) {
+			tpl->integer[j] &= !parse_integer<0>(tpl, line + field_start[j],
+					line + len, &value);
+		}
+	}
+
+	for (j = 0; j < tpl->edfsignals; j++) {
+		tpl->integer[j] &= rows > 0;
+		found += tpl->integer[j];
+	}
+
+	return found;
+}
+
+/*
+ * Picks the kernels for the separator and format of the template and the
+ * line ending of the file, LINES_LF or LINES_CRLF.  With LINES_LF, the fixed
+ * row kernels are used if fixed_rows_detect() found fixed rows.
+ */
+void select_kernels(struct conv_template *tpl, int line_ending) {
+	struct conv_kernels *kernels = &tpl->kernels;
+	int j, integer = 0, fixed = line_ending == LINES_LF
+			&& tpl->fixed.length > 0;
+
+	if (tpl->binary) {
+		kernels->read_row = read_binary_row;
+		kernels->tokenize_row = tokenize_binary_row;
+		switch (tpl->binary) {
+		case BINARY_INT16:
+			select_binary_kernels<BINARY_INT16>(kernels, tpl->big_endian);
+			break;
+		case BINARY_INT32:
+			select_binary_kernels<BINARY_INT32>(kernels, tpl->big_endian);
+			break;
+		case BINARY_FLOAT32:
+			select_binary_kernels<BINARY_FLOAT32>(kernels, tpl->big_endian);
+			break;
+		default:
+			select_binary_kernels<BINARY_FLOAT64>(kernels, tpl->big_endian);
+			break;
+		}
+		select_quantize_kernel(tpl);
+		return;
+	}
+
+	for (j = 0; j < tpl->edfsignals; j++) {
+		integer |= tpl->integer[j];
+	}
+
+	kernels->read_row = line_ending == LINES_CRLF ? read_row_t<true>
+			: fixed ? read_fixed_row : read_row_t<false>;
+
+	switch (tpl->separator) {
+	case ',':
+		select_row_kernels<',', false>(kernels, fixed, integer,
+				tpl->quoted);
+		break;
+	case '\t':
+		select_row_kernels<'\t', true>(kernels, fixed, integer,
+				tpl->quoted);
+		break;
+	case ';':
+		select_row_kernels<';', true>(kernels, fixed, integer,
+				tpl->quoted);
+		break;
+	case ' ':
+		select_row_kernels<' ', true>(kernels, fixed, integer,
+				tpl->quoted);
+		break;
+	default:
+		select_row_kernels<0, true>(kernels, fixed, integer,
+				tpl->quoted);
+		break;
+	}
+
+	select_quantize_kernel(tpl);
+}
+
+/* Picks the quantize kernel for the format and tpl->exact_integers */
+void select_quantize_kernel(struct conv_template *tpl) {
+	int j, exact = 0;
+
+	for (j = 0; j < tpl->edfsignals; j++) {
+		exact |= tpl->exact_integers && tpl->integer[j];
+	}
+
+	if (tpl->edf_format) {
+		tpl->kernels.quantize_row = exact ? quantize_row_t<true, true>
+				: quantize_row_t<true, false>;
+	} else {
+		tpl->kernels.quantize_row = exact ? quantize_row_t<false, true>
+				: quantize_row_t<false, false>;
+	}
+}
+
+/* Generic kernels, testing the template on every call */
+
+int read_row(FILE *inputfile, char *line) {
+	return read_row_t<true>(NULL, inputfile, line);
+}
+
+int tokenize_row(const struct conv_template *tpl, char *line, int len,
+		int *field_start) {
+	if (tpl->quoted) {
+		return tpl->separator == ','
+				? tokenize_quoted_row_t<0, false>(tpl, line, len, field_start)
+				: tokenize_quoted_row_t<0, true>(tpl, line, len, field_start);
+	}
+	if (tpl->separator == ',') {
+		return tokenize_row_t<0, false>(tpl, line, len, field_start);
+	}
+	return tokenize_row_t<0, true>(tpl, line, len, field_start);
+}
+
+int parse_row(const struct conv_template *tpl, char *line, int len,
+		double *value) {
+	if (tpl->quoted) {
+		return tpl->separator == ','
+				? parse_row_t<0, false, false, true>(tpl, line, len, value)
+				: parse_row_t<0, true, false, true>(tpl, line, len, value);
+	}
+	if (tpl->separator == ',') {
+		return parse_row_t<0, false, false, false>(tpl, line, len, value);
+	}
+	return parse_row_t<0, true, false, false>(tpl, line, len, value);
+}
+
+void quantize_row(const struct conv_template *tpl, const double *value,
+		char *buf, int k, int smpls_per_block, long long *clips) {
+	if (tpl->edf_format) {
+		quantize_row_t<true, false>(tpl, value, buf, k, smpls_per_block,
+				clips);
+	} else {
+		quantize_row_t<false, false>(tpl, value, buf, k, smpls_per_block,
+				clips);
+	}
+}
+
+/***************** physical maximum *************************************/
+
+void physmax_reset(double *maxima) {
+	int i;
+
+	for (i = 0; i < MAX_EDF_SIGNALS; i++) {
+		maxima[i] = 0.00001;
+	}
+}
+
+void physmax_update(const double *value, int n, double *maxima) {
+	int j;
+	double v;
+
+	for (j = 0; j < n; j++) {
+		v = value[j];
+		if (v < 0.0) {
+			v *= -1.0;
+		}
+
+		if (maxima[j] < v) {
+			maxima[j] = v;
+		}
+	}
+}
+
+/*
+ * Derives the physical maximum and sensitivity of every output signal from
+ * the absolute maxima found in the data.
+ */
+void physmax_finish(struct conv_template *tpl, const double *maxima) {
+	int i, edf_signal = 0;
+
+	for (i = 0; i < tpl->columns; i++) {
+		if (tpl->column_enabled[i]) {
+			tpl->sigcolumn[edf_signal] = i;
+			tpl->sigphysmax[edf_signal] = maxima[edf_signal]
+					* tpl->multiplier[i];
+
+			if (tpl->sigphysmax[edf_signal] > 9999999.0) {
+				tpl->sigphysmax[edf_signal] = 9999999.0;
+			}
+
+			if (tpl->edf_format) {
+				tpl->sensitivity[edf_signal] = 32767.0
+						/ tpl->sigphysmax[edf_signal];
+			} else {
+				tpl->sensitivity[edf_signal] = 8388607.0
+						/ tpl->sigphysmax[edf_signal];
+			}
+
+			tpl->sensitivity[edf_signal++] *= tpl->multiplier[i];
+		}
+	}
+
+	exact_scaling(tpl);
+}
+
+/*
+ * Same as physmax_finish() for templates which specify the physical maximum
+ * of every column.
+ */
+void physmax_manual(struct conv_template *tpl) {
+	int i, edf_signal = 0;
+
+	for (i = 0; i < tpl->columns; i++) {
+		if (tpl->column_enabled[i]) {
+			tpl->sigcolumn[edf_signal] = i;
+			tpl->sigphysmax[edf_signal] = tpl->physmax[i];
+
+			if (tpl->edf_format) {
+				tpl->sensitivity[edf_signal] = 32767.0 / tpl->physmax[i];
+			} else {
+				tpl->sensitivity[edf_signal] = 8388607.0 / tpl->physmax[i];
+			}
+
+			tpl->sensitivity[edf_signal++] *= tpl->multiplier[i];
+		}
+	}
+
+	exact_scaling(tpl);
+}
+
+/*
+ * Splits the sensitivity of every signal into a 53 bit integer and a power
+ * of two, so that exact_sample() can scale integers without rounding.  Has
+ * to follow every change of the sensitivities.
+ */
+void exact_scaling(struct conv_template *tpl) {
+	int j, e;
+	double f;
+
+	for (j = 0; j < tpl->edfsignals; j++) {
+		if (!isfinite(tpl->sensitivity[j])) {
+			/* anything but 0 saturates */
+			tpl->exact_mantissa[j] = tpl->sensitivity[j] < 0.0 ? -1 : 1;
+			tpl->exact_shift[j] = 0;
+			continue;
+		}
+		f = frexp(tpl->sensitivity[j], &e);
+		tpl->exact_mantissa[j] = (long long) ldexp(f, 53);
+		tpl->exact_shift[j] = 53 - e;
+	}
+}
+
+/***************** datarecords ******************************************/
+
+/*
+ * Chooses the datarecord duration and samples per datarecord for signals
+ * sampled at samplefrequency.
+ */
+void datarecord_params(double samplefrequency, int *smpls_per_block,
+		double *datrecduration) {
+	if (samplefrequency < 1.0) {
+		*datrecduration = 1.0 / samplefrequency;
+		*smpls_per_block = 1;
+	} else {
+		if (((int) samplefrequency) % 10) {
+			*datrecduration = 1.0;
+			*smpls_per_block = (int) samplefrequency;
+		} else {
+			*datrecduration = 0.1;
+			*smpls_per_block = ((int) samplefrequency) / 10;
+		}
+	}
+}
+
+int datarecord_size(const struct conv_template *tpl, int smpls_per_block) {
+	if (tpl->edf_format) {
+		return smpls_per_block * 2 * tpl->edfsignals;
+	}
+	return smpls_per_block * 3 * tpl->edfsignals;
+}
+
+/*
+ * Returns 1 if the 8 character header field holds the datarecord duration
+ * exactly.
+ */
+int exact_duration(double duration) {
+	char str[32];
+
+	snprintf(str, 32, "%.8f", duration);
+	str[8] = 0;
+	return fabs(atof(str) - duration) <= 1e-12 * duration;
+}
+
+/*
+ * Enlarges the datarecords chosen by datarecord_params to a whole number of
+ * them.  With align the datarecord size is made a multiple of align bytes;
+ * the largest datarecord not over max_size bytes is taken, or the smallest
+ * aligned one if none fits.  Only durations the header can hold exactly are
+ * used.
+ */
+void datarecord_fit(const struct conv_template *tpl, long long max_size,
+		long long align, int *smpls_per_block, double *datrecduration) {
+	long long n, step = 1, best = 1, size = datarecord_size(tpl,
+			*smpls_per_block);
+
+	if (align > 0) {
+		n = size;
+		while (n % align) {
+			n += size;
+		}
+		step = n / size;
+		best = 0;
+	}
+
+	for (n = step; n * size <= max_size || best == 0; n += step) {
+		if (n * size > 0x7fffffff) {
+			break;
+		}
+		if (exact_duration(n * *datrecduration)) {
+			best = n;
+		}
+	}
+
+	if (best > 1) {
+		*datrecduration *= best;
+		*smpls_per_block *= best;
+	}
+}
+
+/*
+ * Shrinks the datarecords to at most max_size bytes, row_size bytes per
+ * sample of every signal, by taking fewer samples per datarecord.  Only
+ * durations the header can hold exactly are used.  Returns 1 if not even
+ * one sample per datarecord fits.
+ */
+int datarecord_limit(long long row_size, long long max_size,
+		int *smpls_per_block, double *datrecduration) {
+	double rate = *smpls_per_block / *datrecduration;
+	long long n;
+
+	if (*smpls_per_block * row_size <= max_size) {
+		return 0;
+	}
+
+	for (n = max_size / row_size; n >= 1; n--) {
+		if (exact_duration(n / rate)) {
+			*smpls_per_block = (int) n;
+			*datrecduration = n / rate;
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/***************** header ***********************************************/
+
+/*
+ * Writes the EDF/BDF header with the datarecord count set to -1; it is
+ * patched at offset 236 once the conversion is done.
+ * Returns 0 on success.
+ */
+int write_header(FILE *outputfile, const struct conv_template *tpl,
+		const struct edf_header *hdr) {
+	int i, j, p, edf_signal, edfsignals = tpl->edfsignals;
+	char str[256], scratchpad[128];
+
+	if (tpl->edf_format) {
+		fprintf(outputfile, "0       ");
+	} else {
+		fputc(255, outputfile);
+		fprintf(outputfile, "BIOSEMI");
+	}
+
+	p = snprintf(scratchpad, 128, "%s", hdr->patient_name);
+	for (; p < 80; p++) {
+		scratchpad[p] = ' ';
+	}
+	latin1_to_ascii(scratchpad, 80);
+	scratchpad[80] = 0;
+	fprintf(outputfile, "%s", scratchpad);
+
+	p = snprintf(scratchpad, 128, "%s", hdr->recording);
+	for (; p < 80; p++) {
+		scratchpad[p] = ' ';
+	}
+	latin1_to_ascii(scratchpad, 80);
+	scratchpad[80] = 0;
+	fprintf(outputfile, "%s", scratchpad);
+
+	fprintf(outputfile, "%02i.%02i.%02i%02i.%02i.%02i", hdr->day, hdr->month,
+			hdr->year, hdr->hour, hdr->minute, hdr->second);
+	fprintf(outputfile, "%-8i", 256 * edfsignals + 256);
+	fprintf(outputfile, "                                            ");
+	fprintf(outputfile, "-1      ");
+	if (hdr->datrecduration == 1.0) {
+		fprintf(outputfile, "1       ");
+	} else if (hdr->datrecduration == 0.1) {
+		fprintf(outputfile, "0.1     ");
+	} else {
+		snprintf(str, 256, "%.8f", hdr->datrecduration);
+		if (fwrite(str, 8, 1, outputfile) != 1) {
+			return 1;
+		}
+	}
+	fprintf(outputfile, "%-4i", edfsignals);
+
+	for (i = 0; i < tpl->columns; i++) {
+		if (tpl->column_enabled[i]) {
+			p = fprintf(outputfile, "%s", tpl->signames[i]);
+			for (j = p; j < 16; j++) {
+				fputc(' ', outputfile);
+			}
+		}
+	}
+
+	for (i = 0; i < (80 * edfsignals); i++) {
+		fputc(' ', outputfile);
+	}
+
+	for (i = 0; i < tpl->columns; i++) {
+		if (tpl->column_enabled[i]) {
+			p = fprintf(outputfile, "%s", tpl->sigdimensions[i]);
+			for (j = p; j < 8; j++) {
+				fputc(' ', outputfile);
+			}
+		}
+	}
+
+	/* "%f" of a template maximum may not fit the 8 characters either */
+	for (edf_signal = 0; edf_signal < edfsignals; edf_signal++) {
+		sprintf(str, "%.8f", tpl->sigphysmax[edf_signal] * -1.0);
+		strcat(str, "        ");
+		str[8] = 0;
+		fprintf(outputfile, "%s", str);
+	}
+
+	for (edf_signal = 0; edf_signal < edfsignals; edf_signal++) {
+		sprintf(str, "%.8f", tpl->sigphysmax[edf_signal]);
+		strcat(str, "        ");
+		str[8] = 0;
+		fprintf(outputfile, "%s", str);
+	}
+
+	for (i = 0; i < edfsignals; i++) {
+		if (tpl->edf_format) {
+			fprintf(outputfile, "-32768  ");
+		} else {
+			fprintf(outputfile, "-8388608");
+		}
+	}
+
+	for (i = 0; i < edfsignals; i++) {
+		if (tpl->edf_format) {
+			fprintf(outputfile, "32767   ");
+		} else {
+			fprintf(outputfile, "8388607 ");
+		}
+	}
+
+	for (i = 0; i < (80 * edfsignals); i++) {
+		fputc(' ', outputfile);
+	}
+
+	for (i = 0; i < edfsignals; i++) {
+		fprintf(outputfile, "%-8i", hdr->smpls_per_block);
+	}
+
+	for (i = 0; i < (32 * edfsignals); i++) {
+		fputc(' ', outputfile);
+	}
+
+	return 0;
+}
+
+/***************** template *********************************************/
+
+/*
+ * Reads the optional <binary> element, which makes the rows raw samples:
+ * <sample_type> int16, int32, float32 or float64, <byte_order> little
+ * (the default) or big, and <header_bytes> to skip, 0 by default.  Returns
+ * 1 if it is not valid.
+ */
+static int loadBinaryFormat(struct xml_handle *xml_hdl,
+		struct conv_template *tpl) {
+	static const char *types[] = { "", "int16", "int32", "float32",
+			"float64" };
+	char *content;
+	int error = 0;
+
+	tpl->binary = BINARY_NONE;
+	tpl->big_endian = 0;
+	tpl->header_bytes = 0;
+	if (xml_goto_nth_element_inside(xml_hdl, "binary", 0)) {
+		return 0;
+	}
+
+	if (xml_goto_nth_element_inside(xml_hdl, "sample_type", 0)) {
+		error = 1;
+	} else {
+		content = xml_get_content_of_element(xml_hdl);
+		for (tpl->binary = BINARY_FLOAT64; tpl->binary > BINARY_NONE
+				&& strcmp(content, types[tpl->binary]); tpl->binary--)
+			;
+		error = tpl->binary == BINARY_NONE;
+		free(content);
+		xml_go_up(xml_hdl);
+	}
+
+	if (!error && !xml_goto_nth_element_inside(xml_hdl, "byte_order", 0)) {
+		content = xml_get_content_of_element(xml_hdl);
+		tpl->big_endian = !strcmp(content, "big");
+		error = !tpl->big_endian && strcmp(content, "little");
+		free(content);
+		xml_go_up(xml_hdl);
+	}
+
+	if (!error && !xml_goto_nth_element_inside(xml_hdl, "header_bytes", 0)) {
+		content = xml_get_content_of_element(xml_hdl);
+		tpl->header_bytes = atoi(content);
+		error = tpl->header_bytes < 0;
+		free(content);
+		xml_go_up(xml_hdl);
+	}
+
+	xml_go_up(xml_hdl);
+	return error;
+}
+
+/* Bytes of a binary row */
+int binary_row_size(const struct conv_template *tpl) {
+	static const int size[] = { 0, 2, 4, 4, 8 };
+
+	return tpl->columns * size[tpl->binary];
+}
+
+int loadTemplate(const char *path, struct conv_template *tpl) {
+	int i, temp;
+	/*char path[MAX_PATH_LENGTH];*/
+	char *content;
+	double f_temp;
+	struct xml_handle *xml_hdl;
+
+	if (!strcmp(path, "")) {
+		return 1;
+	}
+
+	xml_hdl = xml_get_handle(path);
+	if (xml_hdl == NULL ) {
+		printf("Error Can not open template file for reading.");
+		return 0;
+	}
+
+	if (strcmp(xml_hdl->elementname, "EDFbrowser_ascii2edf_template")) {
+		printf("Error There seems to be an error in this template.");
+		xml_close(xml_hdl);
+		return 0;
+	}
+
+	if (loadBinaryFormat(xml_hdl, tpl)) {
+		printf("Error There seems to be an error in this template.");
+		xml_close(xml_hdl);
+		return 0;
+	}
+
+	if (xml_goto_nth_element_inside(xml_hdl, "separator", 0)) {
+		/* binary rows have none */
+		if (!tpl->binary) {
+			printf("Error There seems to be an error in this template.");
+			xml_close(xml_hdl);
+			return 0;
+		}
+		tpl->separator = ',';
+	} else {
+		content = xml_get_content_of_element(xml_hdl);
+		if (!strcmp(content, "tab")) {
+			tpl->separator = '\t';
+			free(content);
+		} else {
+			if (strlen(content) != 1) {
+				printf("Error There seems to be an error in this template.");
+				free(content);
+				xml_close(xml_hdl);
+				return 0;
+			} else {
+				if ((content[0] < 32) || (content[0] > 126)) {
+					printf("Error There seems to be an error in this template.");
+					free(content);
+					xml_close(xml_hdl);
+					return 0;
+				}
+				tpl->separator = content[0];
+				free(content);
+			}
+		}
+		xml_go_up(xml_hdl);
+	}
+
+	if (xml_goto_nth_element_inside(xml_hdl, "columns", 0)) {
+		printf("Error There seems to be an error in this template.");
+		xml_close(xml_hdl);
+		return 0;
+	}
+	content = xml_get_content_of_element(xml_hdl);
+	temp = atoi(content);
+	free(content);
+	if ((temp < 1) || (temp > 256)) {
+		printf("Error There seems to be an error in this template.");
+		xml_close(xml_hdl);
+		return 0;
+	}
+	tpl->columns = temp; /*Set number of columns*/
+	xml_go_up(xml_hdl);
+
+	if (tpl->binary) {
+		/* binary rows start after header_bytes */
+		tpl->startline = 1;
+	} else if (xml_goto_nth_element_inside(xml_hdl, "startline", 0)) {
+		printf("Error There seems to be an error in this template.");
+		xml_close(xml_hdl);
+		return 0;
+	} else {
+		content = xml_get_content_of_element(xml_hdl);
+		temp = atoi(content);
+		free(content);
+		if ((temp < 1) || (temp > 100)) {
+			printf("Error There seems to be an error in this template.");
+			xml_close(xml_hdl);
+			return 0;
+		}
+		tpl->startline = temp;
+		xml_go_up(xml_hdl);
+	}
+
+	if (xml_goto_nth_element_inside(xml_hdl, "samplefrequency", 0)) {
+		printf("Error There seems to be an error in this template.");
+		xml_close(xml_hdl);
+		return 0;
+	}
+	content = xml_get_content_of_element(xml_hdl);
+	f_temp = atof(content);
+	free(content);
+	if ((f_temp < 0.0000001) || (f_temp > 1000000.0)) {
+		printf("Error There seems to be an error in this template.");
+		xml_close(xml_hdl);
+		return 0;
+	}
+	tpl->samplefrequency = f_temp;
+	xml_go_up(xml_hdl);
+
+	if (!(xml_goto_nth_element_inside(xml_hdl, "autophysicalmaximum", 0))) {
+		content = xml_get_content_of_element(xml_hdl);
+		tpl->autoPhysicalMaximum = atoi(content);
+		free(content);
+		if ((tpl->autoPhysicalMaximum < 0) || (tpl->autoPhysicalMaximum > 1)) {
+			tpl->autoPhysicalMaximum = 1;
+		}
+		xml_go_up(xml_hdl);
+	}
+
+	if (!(xml_goto_nth_element_inside(xml_hdl, "edf_format", 0))) {
+		content = xml_get_content_of_element(xml_hdl);
+		tpl->edf_format = atoi(content);
+		free(content);
+		if ((tpl->edf_format < 0) || (tpl->edf_format > 1)) {
+			tpl->edf_format = 0;
+		}
+		xml_go_up(xml_hdl);
+	}
+
+	for (i = 0; i < tpl->columns; i++) {
+		if (xml_goto_nth_element_inside(xml_hdl, "signalparams", i)) {
+			printf("Error There seems to be an error in this template.");
+			xml_close(xml_hdl);
+			return 0;
+		}
+
+		if (xml_goto_nth_element_inside(xml_hdl, "checked", 0)) {
+			printf("Error There seems to be an error in this template.");
+			xml_close(xml_hdl);
+			return 0;
+		}
+		content = xml_get_content_of_element(xml_hdl);
+		if (!strcmp(content, "0")) {
+			tpl->column_enabled[i] = 0;
+		} else {
+			tpl->column_enabled[i] = 1;
+			/* also known without physmax_finish(), as when resuming */
+			if (tpl->edfsignals < MAX_EDF_SIGNALS) {
+				tpl->sigcolumn[tpl->edfsignals] = i;
+			}
+			tpl->edfsignals++;
+		}
+		free(content);
+		xml_go_up(xml_hdl);
+
+		if (tpl->edfsignals > MAX_EDF_SIGNALS) {
+			printf("Error Too many signals in this template.");
+			xml_close(xml_hdl);
+			return 0;
+		}
+
+		if (xml_goto_nth_element_inside(xml_hdl, "label", 0)) {
+			printf("Error There seems to be an error in this template.");
+			xml_close(xml_hdl);
+			return 0;
+		}
+		content = xml_get_content_of_element(xml_hdl);
+		snprintf(tpl->signames[i], 128, "%s", content);
+		free(content);
+		xml_go_up(xml_hdl);
+
+		if (xml_goto_nth_element_inside(xml_hdl, "physical_maximum", 0)) {
+			printf("Error There seems to be an error in this template.");
+			xml_close(xml_hdl);
+			return 0;
+		}
+		content = xml_get_content_of_element(xml_hdl);
+		tpl->physmax[i] = atof(content);
+		free(content);
+		xml_go_up(xml_hdl);
+
+		if (xml_goto_nth_element_inside(xml_hdl, "physical_dimension", 0)) {
+			printf("Error There seems to be an error in this template.");
+			xml_close(xml_hdl);
+			return 0;
+		}
+		content = xml_get_content_of_element(xml_hdl);
+		snprintf(tpl->sigdimensions[i], 128, "%s", content);
+		free(content);
+		xml_go_up(xml_hdl);
+
+		if (xml_goto_nth_element_inside(xml_hdl, "multiplier", 0)) {
+			printf("Error There seems to be an error in this template.");
+			xml_close(xml_hdl);
+			return 0;
+		}
+		content = xml_get_content_of_element(xml_hdl);
+		tpl->multiplier[i] = atof(content);
+		free(content);
+		xml_go_up(xml_hdl);
+		xml_go_up(xml_hdl);
+	}
+	xml_close(xml_hdl);
+	select_kernels(tpl, LINES_CRLF);
+	return 1;
+}
+
+void initSignalTable(struct conv_template *tpl) {
+	int i;
+	tpl->autoPhysicalMaximum = 0;
+	tpl->edf_format = 0;
+	tpl->edfsignals = 0;
+	tpl->binary = BINARY_NONE;
+	tpl->fixed.length = 0;
+	tpl->quoted = 0;
+	tpl->exact_integers = 0;
+	for (i = 0; i < MAX_COLUMNS; i++) {
+		tpl->physmax[i] = 0;
+		tpl->multiplier[i] = 1.000;
+		tpl->column_enabled[i] = 0;
+	}
+	for (i = 0; i < MAX_EDF_SIGNALS; i++) {
+		tpl->integer[i] = 0;
+	}
+	select_kernels(tpl, LINES_CRLF);
+}
+
+void latin1_to_ascii(char *str, int len) {
+  int i, value;
+  for(i=0; i<len; i++) {
+    value = *((unsigned char *)(str + i));
+    if((value>31)&&(value<127)) {
+    	continue;
+    }
+
+    switch(value) {
+      case 128 : str[i] = 'E';  break;
+      case 130 : str[i] = ',';  break;
+      case 131 : str[i] = 'F';  break;
+      case 132 : str[i] = '\"';  break;
+      case 133 : str[i] = '.';  break;
+      case 134 : str[i] = '+';  break;
+      case 135 : str[i] = '+';  break;
+      case 136 : str[i] = '^';  break;
+      case 137 : str[i] = 'm';  break;
+      case 138 : str[i] = 'S';  break;
+      case 139 : str[i] = '<';  break;
+      case 140 : str[i] = 'E';  break;
+      case 142 : str[i] = 'Z';  break;
+      case 145 : str[i] = '`';  break;
+      case 146 : str[i] = '\'';  break;
+      case 147 : str[i] = '\"';  break;
+      case 148 : str[i] = '\"';  break;
+      case 149 : str[i] = '.';  break;
+      case 150 : str[i] = '-';  break;
+      case 151 : str[i] = '-';  break;
+      case 152 : str[i] = '~';  break;
+      case 154 : str[i] = 's';  break;
+      case 155 : str[i] = '>';  break;
+      case 156 : str[i] = 'e';  break;
+      case 158 : str[i] = 'z';  break;
+      case 159 : str[i] = 'Y';  break;
+      case 171 : str[i] = '<';  break;
+      case 180 : str[i] = '\'';  break;
+      case 181 : str[i] = 'u';  break;
+      case 187 : str[i] = '>';  break;
+      case 191 : str[i] = '\?';  break;
+      case 192 : str[i] = 'A';  break;
+      case 193 : str[i] = 'A';  break;
+      case 194 : str[i] = 'A';  break;
+      case 195 : str[i] = 'A';  break;
+      case 196 : str[i] = 'A';  break;
+      case 197 : str[i] = 'A';  break;
+      case 198 : str[i] = 'E';  break;
+      case 199 : str[i] = 'C';  break;
+      case 200 : str[i] = 'E';  break;
+      case 201 : str[i] = 'E';  break;
+      case 202 : str[i] = 'E';  break;
+      case 203 : str[i] = 'E';  break;
+      case 204 : str[i] = 'I';  break;
+      case 205 : str[i] = 'I';  break;
+      case 206 : str[i] = 'I';  break;
+      case 207 : str[i] = 'I';  break;
+      case 208 : str[i] = 'D';  break;
+      case 209 : str[i] = 'N';  break;
+      case 210 : str[i] = 'O';  break;
+      case 211 : str[i] = 'O';  break;
+      case 212 : str[i] = 'O';  break;
+      case 213 : str[i] = 'O';  break;
+      case 214 : str[i] = 'O';  break;
+      case 215 : str[i] = 'x';  break;
+      case 216 : str[i] = 'O';  break;
+      case 217 : str[i] = 'U';  break;
+      case 218 : str[i] = 'U';  break;
+      case 219 : str[i] = 'U';  break;
+      case 220 : str[i] = 'U';  break;
+      case 221 : str[i] = 'Y';  break;
+      case 222 : str[i] = 'I';  break;
+      case 223 : str[i] = 's';  break;
+      case 224 : str[i] = 'a';  break;
+      case 225 : str[i] = 'a';  break;
+      case 226 : str[i] = 'a';  break;
+      case 227 : str[i] = 'a';  break;
+      case 228 : str[i] = 'a';  break;
+      case 229 : str[i] = 'a';  break;
+      case 230 : str[i] = 'e';  break;
+      case 231 : str[i] = 'c';  break;
+      case 232 : str[i] = 'e';  break;
+      case 233 : str[i] = 'e';  break;
+      case 234 : str[i] = 'e';  break;
+      case 235 : str[i] = 'e';  break;
+      case 236 : str[i] = 'i';  break;
+      case 237 : str[i] = 'i';  break;
+      case 238 : str[i] = 'i';  break;
+      case 239 : str[i] = 'i';  break;
+      case 240 : str[i] = 'd';  break;
+      case 241 : str[i] = 'n';  break;
+      case 242 : str[i] = 'o';  break;
+      case 243 : str[i] = 'o';  break;
+      case 244 : str[i] = 'o';  break;
+      case 245 : str[i] = 'o';  break;
+      case 246 : str[i] = 'o';  break;
+      case 247 : str[i] = '-';  break;
+      case 248 : str[i] = '0';  break;
+      case 249 : str[i] = 'u';  break;
+      case 250 : str[i] = 'u';  break;
+      case 251 : str[i] = 'u';  break;
+      case 252 : str[i] = 'u';  break;
+      case 253 : str[i] = 'y';  break;
+      case 254 : str[i] = 't';  break;
+      case 255 : str[i] = 'y';  break;
+      default  : str[i] = ' ';  break;
+    }
+  }
+}
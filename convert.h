@@ -0,0 +1,177 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Template handling and the per-row kernels of the ascii to EDF
+ * converter, shared by ascii2edf and the benchmark driver.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#ifndef convert_INCLUDED
+#define convert_INCLUDED
+
+#include <stdio.h>
+
+#define MAX_PATH_LENGTH 1024
+#define MAX_EDF_SIGNALS 128
+#define MAX_COLUMNS 256
+#define MAX_LINE_LENGTH 2046
+
+/* read_row() results other than a line length */
+#define ROW_EOF -1
+#define ROW_TOO_LONG -2
+
+/* Sample types of binary input, see loadTemplate() */
+#define BINARY_NONE 0 /* text */
+#define BINARY_INT16 1
+#define BINARY_INT32 2
+#define BINARY_FLOAT32 3
+#define BINARY_FLOAT64 4
+
+/* Line endings for select_kernels() */
+#define LINES_LF 0 /* carriage returns only before a newline */
+#define LINES_CRLF 1 /* carriage returns anywhere */
+
+struct conv_template;
+
+/*
+ * Layout of csv rows which all have the same length and their fields in the
+ * same places, see fixed_rows_detect().  Rows are checked against it instead
+ * of being tokenized.
+ */
+struct fixed_rows {
+	int length; /* characters before the line ending, 0 if rows vary */
+	int bytes; /* of a row, line ending included */
+	int ngaps; /* runs of separators */
+	short gap_start[MAX_COLUMNS + 1];
+	short gap_end[MAX_COLUMNS + 1];
+	int nskipped; /* columns which are not converted */
+	short skipped_start[MAX_COLUMNS];
+	short skipped_end[MAX_COLUMNS];
+	/* per output signal */
+	short start[MAX_EDF_SIGNALS];
+	short point[MAX_EDF_SIGNALS]; /* of the decimal point, end if none */
+	short end[MAX_EDF_SIGNALS];
+	double scale[MAX_EDF_SIGNALS]; /* 10 to the number of decimals */
+};
+
+/* Row kernels specialized for a template, see select_kernels() */
+struct conv_kernels {
+	int (*read_row)(const struct conv_template *tpl, FILE *inputfile,
+			char *line);
+	int (*tokenize_row)(const struct conv_template *tpl, char *line, int len,
+			int *field_start);
+	int (*parse_row)(const struct conv_template *tpl, char *line, int len,
+			double *value);
+	void (*quantize_row)(const struct conv_template *tpl, const double *value,
+			char *buf, int k, int smpls_per_block, long long *clips);
+};
+
+struct conv_template {
+	char separator; /* CSV file separator */
+	int columns; /* number of columns in csv */
+	int startline; /* which line of csv data starts */
+	double samplefrequency; /* frequency of csv samples */
+	int autoPhysicalMaximum; /* should physical maxima be autodetected */
+	int edf_format; /* edf/bdf format switch */
+	int edfsignals; /* how many signals are to be output */
+
+	/* Rows of raw interleaved samples, one per column, instead of text */
+	int binary; /* sample type, BINARY_NONE for text */
+	int big_endian;
+	int header_bytes; /* before the first row */
+
+	/* Per column info from template */
+	double physmax[MAX_COLUMNS];
+	double multiplier[MAX_COLUMNS];
+	char signames[MAX_COLUMNS][128];
+	char sigdimensions[MAX_COLUMNS][128];
+	int column_enabled[MAX_COLUMNS];
+
+	/* Per output signal, filled in before the header is written */
+	int sigcolumn[MAX_EDF_SIGNALS];
+	double sigphysmax[MAX_EDF_SIGNALS];
+	double sensitivity[MAX_EDF_SIGNALS];
+	/* sensitivity as exact_mantissa * 2^-exact_shift, see exact_scaling() */
+	long long exact_mantissa[MAX_EDF_SIGNALS];
+	int exact_shift[MAX_EDF_SIGNALS];
+
+	/* Found in the csv file, see integer_columns_detect() */
+	int integer[MAX_EDF_SIGNALS]; /* the column holds integers */
+	int quoted; /* fields may be in double quotes */
+	int exact_integers; /* scale integers exactly and round them */
+	struct fixed_rows fixed;
+	struct conv_kernels kernels;
+};
+
+struct edf_header {
+	const char *patient_name;
+	const char *recording;
+	int day, month, year, hour, minute, second;
+	int smpls_per_block;
+	double datrecduration;
+};
+
+int loadTemplate(const char *path, struct conv_template *tpl);
+int binary_row_size(const struct conv_template *tpl);
+void initSignalTable(struct conv_template *tpl);
+void latin1_to_ascii(char *, int);
+
+int read_row(FILE *inputfile, char *line);
+int tokenize_row(const struct conv_template *tpl, char *line, int len,
+		int *field_start);
+int parse_row(const struct conv_template *tpl, char *line, int len,
+		double *value);
+
+int fixed_rows_detect(struct conv_template *tpl, const char *text, int n);
+int integer_columns_detect(struct conv_template *tpl, const char *text,
+		int n);
+void select_kernels(struct conv_template *tpl, int line_ending);
+void select_quantize_kernel(struct conv_template *tpl);
+
+void physmax_reset(double *maxima);
+void physmax_update(const double *value, int n, double *maxima);
+void physmax_finish(struct conv_template *tpl, const double *maxima);
+void physmax_manual(struct conv_template *tpl);
+void exact_scaling(struct conv_template *tpl);
+
+void datarecord_params(double samplefrequency, int *smpls_per_block,
+		double *datrecduration);
+int datarecord_size(const struct conv_template *tpl, int smpls_per_block);
+int exact_duration(double duration);
+void datarecord_fit(const struct conv_template *tpl, long long max_size,
+		long long align, int *smpls_per_block, double *datrecduration);
+int datarecord_limit(long long row_size, long long max_size,
+		int *smpls_per_block, double *datrecduration);
+void quantize_row(const struct conv_template *tpl, const double *value,
+		char *buf, int k, int smpls_per_block, long long *clips);
+
+int write_header(FILE *outputfile, const struct conv_template *tpl,
+		const struct edf_header *hdr);
+
+#endif
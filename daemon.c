@@ -0,0 +1,456 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Conversion daemon.  Clients connect to a Unix socket and send one job per
+ * line: the arguments of a normal ascii2edf run, separated by tabs.  Two
+ * extra options are understood:
+ *
+ *  --priority=<n>  jobs with a higher priority run first (default 0)
+ *  --tag=<text>    echoed in every reply about the job
+ *
+ * Every job gets JSON replies on the same connection, one per line:
+ *
+ *  {"job":7,"tag":"x","status":"queued","priority":0}
+ *  {"job":7,"tag":"x","status":"running"}
+ *  {"job":7,"tag":"x","status":"done","result":0,"wall_s":0.012,...}
+ *
+ * where the last one has status "error" if the job failed, and further
+ * fields from the job runner.  A fixed pool of max_jobs threads takes the
+ * jobs from the queue, so at most max_jobs conversions run at a time.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#include "daemon.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/* A connection; jobs keep it open until their reply is written */
+struct client {
+	int fd;
+	int refs;
+	pthread_mutex_t lock;
+};
+
+struct queued_job {
+	long long id;
+	int priority;
+	const char *tag;
+	int argc;
+	char *argv[DAEMON_MAX_ARGS];
+	char *line; /* holds the arguments */
+	struct client *client;
+	struct queued_job *next;
+};
+
+/* Where stdout of the job run by this thread goes, NULL for the daemon */
+static __thread FILE *job_output;
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_wake = PTHREAD_COND_INITIALIZER;
+static struct queued_job *queue; /* highest priority first */
+static long long last_id;
+static daemon_job run_job;
+
+static double monotonic(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void client_unref(struct client *c) {
+	int refs;
+
+	pthread_mutex_lock(&c->lock);
+	refs = --c->refs;
+	pthread_mutex_unlock(&c->lock);
+
+	if (refs == 0) {
+		close(c->fd);
+		pthread_mutex_destroy(&c->lock);
+		free(c);
+	}
+}
+
+FILE *daemon_job_output(void) {
+	return job_output;
+}
+
+/* Sends stdout of the calling thread to f, for threads a job starts */
+void daemon_set_job_output(FILE *f) {
+	job_output = f;
+}
+
+/*
+ * stdout of the daemon.  It is unbuffered, so every printf reaches this on
+ * the thread that made it, and lands in the output of that thread's job.
+ */
+static ssize_t stdout_write(void *cookie, const char *buf, size_t n) {
+	size_t done = 0;
+	ssize_t k;
+
+	(void) cookie;
+	if (job_output != NULL) {
+		return fwrite(buf, 1, n, job_output);
+	}
+	while (done < n) {
+		k = write(STDOUT_FILENO, buf + done, n - done);
+		if (k < 0 && errno == EINTR) {
+			continue;
+		}
+		if (k <= 0) {
+			return done > 0 ? (ssize_t) done : -1;
+		}
+		done += k;
+	}
+	return n;
+}
+
+static void json_string(FILE *f, const char *str, size_t len) {
+	size_t i;
+
+	fputc('"', f);
+	for (i = 0; i < len; i++) {
+		if (str[i] == '"' || str[i] == '\\') {
+			fprintf(f, "\\%c", str[i]);
+		} else if ((unsigned char) str[i] < 32) {
+			fprintf(f, "\\u%04x", (unsigned char) str[i]);
+		} else {
+			fputc(str[i], f);
+		}
+	}
+	fputc('"', f);
+}
+
+/* Writes a reply line; a client that went away is not an error */
+static void reply(struct client *c, const char *text, size_t len) {
+	ssize_t n;
+
+	pthread_mutex_lock(&c->lock);
+	while (len > 0) {
+		n = write(c->fd, text, len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		text += n;
+		len -= n;
+	}
+	pthread_mutex_unlock(&c->lock);
+}
+
+/* Starts a reply about a job: {"job":<id>,"tag":<tag>, */
+static void reply_start(FILE *f, const struct queued_job *job) {
+	fprintf(f, "{\"job\":%lld,", job->id);
+	if (job->tag != NULL) {
+		fputs("\"tag\":", f);
+		json_string(f, job->tag, strlen(job->tag));
+		fputc(',', f);
+	}
+}
+
+static void reply_status(const struct queued_job *job, const char *status) {
+	char *text = NULL;
+	size_t len = 0;
+	FILE *f = open_memstream(&text, &len);
+
+	if (f == NULL) {
+		return;
+	}
+	reply_start(f, job);
+	fprintf(f, "\"status\":\"%s\"", status);
+	if (!strcmp(status, "queued")) {
+		fprintf(f, ",\"priority\":%d", job->priority);
+	}
+	fputs("}\n", f);
+	fclose(f);
+
+	reply(job->client, text, len);
+	free(text);
+}
+
+/*
+ * Splits a job line into arguments and queues it behind the jobs of the
+ * same or a higher priority.
+ */
+static void submit(struct client *c, const char *line) {
+	struct queued_job *job, **p;
+	char *arg, *end;
+	const char *error;
+
+	job = (struct queued_job *) calloc(1, sizeof(struct queued_job));
+	if (job == NULL || (job->line = strdup(line)) == NULL) {
+		free(job);
+		error = "{\"job\":0,\"status\":\"error\",\"message\":\"out of memory\"}\n";
+		reply(c, error, strlen(error));
+		return;
+	}
+	job->client = c;
+
+	for (arg = job->line; arg != NULL; arg = end) {
+		end = strchr(arg, '\t');
+		if (end != NULL) {
+			*end++ = 0;
+		}
+
+		if (!strncmp(arg, "--priority=", 11)) {
+			job->priority = atoi(arg + 11);
+		} else if (!strncmp(arg, "--tag=", 6)) {
+			job->tag = arg + 6;
+		} else if (job->argc < DAEMON_MAX_ARGS) {
+			job->argv[job->argc++] = arg;
+		} else {
+			job->argc = -1;
+			break;
+		}
+	}
+
+	if (job->argc < 0) {
+		error = "{\"job\":0,\"status\":\"error\",\"message\":\"too many arguments\"}\n";
+		reply(c, error, strlen(error));
+		free(job->line);
+		free(job);
+		return;
+	}
+
+	pthread_mutex_lock(&c->lock);
+	c->refs++;
+	pthread_mutex_unlock(&c->lock);
+
+	pthread_mutex_lock(&queue_lock);
+	job->id = ++last_id;
+	for (p = &queue; *p != NULL && (*p)->priority >= job->priority;
+			p = &(*p)->next)
+		;
+	job->next = *p;
+	*p = job;
+	/* under the queue lock, so "queued" always comes before "running" */
+	reply_status(job, "queued");
+	pthread_cond_signal(&queue_wake);
+	pthread_mutex_unlock(&queue_lock);
+}
+
+static void *client_reader(void *arg) {
+	struct client *c = (struct client *) arg;
+	FILE *in;
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	int fd = dup(c->fd);
+
+	in = fd >= 0 ? fdopen(fd, "r") : NULL;
+	if (in == NULL) {
+		if (fd >= 0) {
+			close(fd);
+		}
+		client_unref(c);
+		return NULL;
+	}
+
+	while ((len = getline(&line, &size, in)) > 0) {
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+			line[--len] = 0;
+		}
+		if (len > 0) {
+			submit(c, line);
+		}
+	}
+
+	free(line);
+	fclose(in);
+	client_unref(c);
+	return NULL;
+}
+
+static void *worker(void *arg) {
+	struct queued_job *job;
+	char *result, *text, *output;
+	size_t result_len, text_len, output_len;
+	FILE *f;
+	double start;
+	int status;
+
+	for (;;) {
+		pthread_mutex_lock(&queue_lock);
+		while (queue == NULL) {
+			pthread_cond_wait(&queue_wake, &queue_lock);
+		}
+		job = queue;
+		queue = job->next;
+		pthread_mutex_unlock(&queue_lock);
+
+		reply_status(job, "running");
+
+		result = NULL;
+		result_len = 0;
+		output = NULL;
+		output_len = 0;
+		start = monotonic();
+		f = open_memstream(&result, &result_len);
+		job_output = open_memstream(&output, &output_len);
+		status = f != NULL && job_output != NULL ?
+				run_job(job->argc, job->argv, f) : 1;
+		if (f != NULL) {
+			fclose(f);
+		}
+		if (job_output != NULL) {
+			fclose(job_output);
+			job_output = NULL;
+		}
+		while (output_len > 0 && (output[output_len - 1] == '\n'
+				|| output[output_len - 1] == ' ')) {
+			output_len--;
+		}
+
+		text = NULL;
+		text_len = 0;
+		f = open_memstream(&text, &text_len);
+		if (f != NULL) {
+			reply_start(f, job);
+			fprintf(f, "\"status\":\"%s\",\"result\":%d,\"wall_s\":%.6f",
+					status ? "error" : "done", status, monotonic() - start);
+			if (output_len > 0) {
+				fputs(",\"message\":", f);
+				json_string(f, output, output_len);
+			}
+			fprintf(f, "%s}\n", result != NULL ? result : "");
+			fclose(f);
+			reply(job->client, text, text_len);
+		}
+		free(text);
+		free(result);
+		free(output);
+
+		client_unref(job->client);
+		free(job->line);
+		free(job);
+	}
+
+	return NULL;
+}
+
+/*
+ * Listens on path and runs the jobs sent to it, at most max_jobs at a time.
+ * Only returns if the socket can not be set up.
+ */
+int daemon_run(const char *path, int max_jobs, daemon_job run) {
+	struct sockaddr_un addr;
+	struct stat st;
+	struct client *c;
+	pthread_t thread;
+	pthread_attr_t attr;
+	cookie_io_functions_t io = { NULL, stdout_write, NULL, NULL };
+	FILE *f;
+	int fd, conn, i;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printf("Socket path %s is too long", path);
+		return 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	run_job = run;
+
+	fflush(stdout);
+	f = fopencookie(NULL, "w", io);
+	if (f == NULL || setvbuf(f, NULL, _IONBF, 0)) {
+		printf("Can not set up the output of jobs");
+		return 1;
+	}
+	stdout = f;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		printf("Can not create socket");
+		return 1;
+	}
+
+	/* a socket left behind by an earlier daemon */
+	if (!lstat(path, &st) && S_ISSOCK(st.st_mode)) {
+		unlink(path);
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) || listen(fd, 64)) {
+		printf("Can not listen on %s", path);
+		close(fd);
+		return 1;
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	for (i = 0; i < max_jobs; i++) {
+		if (pthread_create(&thread, &attr, worker, NULL)) {
+			printf("Can not start worker threads");
+			close(fd);
+			return 1;
+		}
+	}
+
+	printf("Listening on %s with %d workers\n", path, max_jobs);
+	fflush(stdout);
+
+	for (;;) {
+		conn = accept(fd, NULL, NULL);
+		if (conn < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			printf("Error accepting connections on %s", path);
+			close(fd);
+			return 1;
+		}
+
+		c = (struct client *) calloc(1, sizeof(struct client));
+		if (c == NULL) {
+			close(conn);
+			continue;
+		}
+		c->fd = conn;
+		c->refs = 1;
+		pthread_mutex_init(&c->lock, NULL);
+
+		if (pthread_create(&thread, &attr, client_reader, c)) {
+			client_unref(c);
+		}
+	}
+}
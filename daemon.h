@@ -0,0 +1,55 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Conversion daemon for --daemon: accepts jobs on a Unix socket and runs
+ * them on a fixed pool of threads, highest priority first.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#ifndef daemon_INCLUDED
+#define daemon_INCLUDED
+
+#include <stdio.h>
+
+/* Arguments per job line, options included */
+#define DAEMON_MAX_ARGS 64
+
+/*
+ * Runs one job given as command line arguments.  Anything written to result
+ * is added to the JSON reply, so it must be a list of ,"name":value pairs.
+ * What the job prints to stdout is returned as "message".  Returns 0 on
+ * success.
+ */
+typedef int (*daemon_job)(int argc, char *argv[], FILE *result);
+
+int daemon_run(const char *path, int max_jobs, daemon_job run);
+FILE *daemon_job_output(void);
+void daemon_set_job_output(FILE *f);
+
+#endif
@@ -0,0 +1,212 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Anti-aliased decimation by an integer factor M.  The low-pass filter is
+ * a linear phase Kaiser windowed sinc with 2 * 16 * M + 1 taps and its
+ * cutoff just below the output Nyquist frequency.  As in a polyphase
+ * decimator the filter is only evaluated at the output instants, once per
+ * M input rows.  Every signal keeps its own history, so filtering runs on
+ * across datarecord boundaries.  Output is centred on its input row
+ * (the group delay is compensated) and the signal is extended with its
+ * first and last value at the edges.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#include "decimate.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define KAISER_BETA 8.0 /* about 80 dB stopband attenuation */
+#define CUTOFF 0.84 /* half amplitude point, relative to output Nyquist */
+
+static double bessel_i0(double x) {
+	double sum = 1.0, term = 1.0;
+	int k;
+
+	for (k = 1; k < 50; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1e-17) {
+			break;
+		}
+	}
+	return sum;
+}
+
+static double dot(const double *a, const double *b, int n) {
+	int i = 0;
+	double sum;
+#if defined(__AVX__)
+	__m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+	double lanes[4];
+
+	for (; i + 8 <= n; i += 8) {
+		acc0 = _mm256_add_pd(acc0,
+				_mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+		acc1 = _mm256_add_pd(acc1,
+				_mm256_mul_pd(_mm256_loadu_pd(a + i + 4),
+						_mm256_loadu_pd(b + i + 4)));
+	}
+	_mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+	sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(__SSE2__)
+	__m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+	double lanes[2];
+
+	for (; i + 4 <= n; i += 4) {
+		acc0 = _mm_add_pd(acc0,
+				_mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+		acc1 = _mm_add_pd(acc1,
+				_mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+	}
+	_mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+	sum = lanes[0] + lanes[1];
+#else
+	sum = 0.0;
+#endif
+	for (; i < n; i++) {
+		sum += a[i] * b[i];
+	}
+	return sum;
+}
+
+int decimator_init(struct decimator *dec, int factor, int nsignals) {
+	int i;
+	double fc, x, t, gain = 0.0;
+
+	memset(dec, 0, sizeof(*dec));
+	dec->factor = factor;
+	dec->half = DECIMATE_HALF_TAPS * factor;
+	dec->taps = 2 * dec->half + 1;
+	dec->nsignals = nsignals;
+
+	dec->coef = (double *) malloc(sizeof(double) * dec->taps);
+	dec->history = (double *) malloc(
+			sizeof(double) * 2 * dec->taps * (nsignals > 0 ? nsignals : 1));
+	dec->last = (double *) malloc(
+			sizeof(double) * (nsignals > 0 ? nsignals : 1));
+	if (dec->coef == NULL || dec->history == NULL || dec->last == NULL) {
+		decimator_free(dec);
+		return 1;
+	}
+
+	/* cutoff in cycles per input sample */
+	fc = CUTOFF * 0.5 / factor;
+
+	for (i = 0; i < dec->taps; i++) {
+		x = i - dec->half;
+		t = x / dec->half;
+		dec->coef[i] = (x == 0.0 ? 2.0 * fc : sin(2.0 * M_PI * fc * x) / (M_PI * x))
+				* bessel_i0(KAISER_BETA * sqrt(1.0 - t * t))
+				/ bessel_i0(KAISER_BETA);
+		gain += dec->coef[i];
+	}
+
+	for (i = 0; i < dec->taps; i++) {
+		dec->coef[i] /= gain;
+	}
+
+	return 0;
+}
+
+static int push(struct decimator *dec, const double *value, double *out) {
+	int j, k, taps = dec->taps;
+	double *h;
+
+	if (dec->pushed == 0) {
+		/* extend the signal backwards with its first value */
+		for (j = 0; j < dec->nsignals; j++) {
+			h = dec->history + (long long) j * 2 * taps;
+			for (k = 0; k < 2 * taps; k++) {
+				h[k] = value[j];
+			}
+		}
+	}
+
+	for (j = 0; j < dec->nsignals; j++) {
+		h = dec->history + (long long) j * 2 * taps;
+		h[dec->pos] = value[j];
+		h[dec->pos + taps] = value[j];
+	}
+	dec->pos++;
+	if (dec->pos == taps) {
+		dec->pos = 0;
+	}
+	dec->pushed++;
+
+	if (dec->pushed - 1 - dec->half != dec->next_center) {
+		return 0;
+	}
+
+	/* the filter is symmetric, so the order of the history does not matter */
+	for (j = 0; j < dec->nsignals; j++) {
+		out[j] = dot(dec->coef,
+				dec->history + (long long) j * 2 * taps + dec->pos, taps);
+	}
+	dec->next_center += dec->factor;
+
+	return 1;
+}
+
+/*
+ * Feeds one input row.  Returns 1 and fills out when an output row is ready.
+ */
+int decimator_push(struct decimator *dec, const double *value, double *out) {
+	memcpy(dec->last, value, sizeof(double) * dec->nsignals);
+	dec->inputs++;
+
+	return push(dec, value, out);
+}
+
+/*
+ * Produces the output rows still held back by the group delay once the
+ * input has ended.  Call until it returns 0.
+ */
+int decimator_flush(struct decimator *dec, double *out) {
+	while (dec->next_center <= dec->inputs - 1) {
+		if (push(dec, dec->last, out)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+void decimator_free(struct decimator *dec) {
+	free(dec->coef);
+	free(dec->history);
+	free(dec->last);
+	dec->coef = NULL;
+	dec->history = NULL;
+	dec->last = NULL;
+}
@@ -0,0 +1,60 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Anti-aliased decimation by an integer factor, applied to the values of
+ * every output signal between parsing and quantization.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#ifndef decimate_INCLUDED
+#define decimate_INCLUDED
+
+/* Filter taps on either side of the centre tap, per unit of the factor */
+#define DECIMATE_HALF_TAPS 16
+
+struct decimator {
+	int factor;
+	int taps; /* 2 * half + 1 */
+	int half; /* group delay in input samples */
+	int nsignals;
+	double *coef;
+	double *history; /* per signal, taps samples stored twice */
+	double *last; /* last input row, repeated when flushing */
+	int pos; /* next write position in the history */
+	long long pushed; /* rows pushed, flush padding included */
+	long long inputs; /* real input rows */
+	long long next_center; /* input row of the next output */
+};
+
+int decimator_init(struct decimator *dec, int factor, int nsignals);
+int decimator_push(struct decimator *dec, const double *value, double *out);
+int decimator_flush(struct decimator *dec, double *out);
+void decimator_free(struct decimator *dec);
+
+#endif
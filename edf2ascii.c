@@ -0,0 +1,369 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Converts an EDF or BDF file written by ascii2edf back into a csv file
+ * laid out as the template describes, so that the same template converts
+ * it again.  Every sample is written as its digital value divided by the
+ * sensitivity, in the shortest form that reads back as the same double.
+ * The datarecords are formatted by several threads, each taking chunks of
+ * them in turn, and the chunks are written in order.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#include "convert.h"
+#include "edffile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <charconv>
+
+/* Rows formatted at a time by a worker */
+#define CHUNK_ROWS 65536
+
+/* Characters of a formatted value at most, separator included */
+#define VALUE_CHARS 26
+
+struct export_plan {
+	const struct edf_file *f;
+	const struct conv_template *tpl;
+	FILE *outputfile;
+	double sensitivity[MAX_EDF_SIGNALS];
+	int signal[MAX_COLUMNS]; /* of each column, -1 if not converted */
+	long long chunk_records;
+	long long nchunks;
+	long long next; /* next chunk to be taken by a worker */
+	long long next_write; /* next chunk to be written */
+	int error;
+	pthread_mutex_t lock;
+	pthread_cond_t written;
+};
+
+/*
+ * The csv value of a digital sample.  ascii2edf truncates value *
+ * sensitivity, so where the quotient rounded below the digital value it is
+ * moved up to the next double, and the csv file converts to the same
+ * samples again.
+ */
+static inline double csv_value(int digital, double sensitivity) {
+	double value = digital / sensitivity;
+	int k;
+
+	for (k = 0; k < 4 && (int) (value * sensitivity) != digital; k++) {
+		value = nextafter(value, digital < 0 ? -HUGE_VAL : HUGE_VAL);
+	}
+	return value;
+}
+
+static inline int sample(const struct edf_file *f, const unsigned char *p) {
+	if (f->bdf) {
+		return ((p[0] | (p[1] << 8) | (p[2] << 16)) << 8) >> 8;
+	}
+	return (short) (p[0] | (p[1] << 8));
+}
+
+/* Formats the datarecords [first, end) into buf, returns the length */
+static size_t format_records(const struct export_plan *plan, long long first,
+		long long end, char *buf) {
+	const struct edf_file *f = plan->f;
+	const struct conv_template *tpl = plan->tpl;
+	const int n = f->smpls_per_block, bytes = f->bdf ? 3 : 2;
+	const unsigned char *record;
+	char *p = buf;
+	long long r;
+	int k, c, j;
+
+	for (r = first; r < end; r++) {
+		record = f->data + f->headersize + r * f->recordsize;
+		for (k = 0; k < n; k++) {
+			for (c = 0; c < tpl->columns; c++) {
+				if (c > 0) {
+					*p++ = tpl->separator;
+				}
+				j = plan->signal[c];
+				if (j < 0) {
+					*p++ = '0';
+				} else {
+					p = std::to_chars(p, p + VALUE_CHARS,
+							csv_value(sample(f, record + (j * n + k) * bytes),
+									plan->sensitivity[j])).ptr;
+				}
+			}
+			*p++ = '\n';
+		}
+	}
+
+	return p - buf;
+}
+
+struct export_worker {
+	struct export_plan *plan;
+	char *buf; /* for the rows of a chunk */
+};
+
+static void *export_worker(void *arg) {
+	struct export_plan *plan = ((struct export_worker *) arg)->plan;
+	char *buf = ((struct export_worker *) arg)->buf;
+	long long c, first, end;
+	size_t len;
+
+	while (!__atomic_load_n(&plan->error, __ATOMIC_RELAXED)) {
+		c = __atomic_fetch_add(&plan->next, 1, __ATOMIC_RELAXED);
+		if (c >= plan->nchunks) {
+			break;
+		}
+
+		first = c * plan->chunk_records;
+		end = first + plan->chunk_records;
+		if (end > plan->f->datarecords) {
+			end = plan->f->datarecords;
+		}
+		len = format_records(plan, first, end, buf);
+
+		/* chunks go out in order */
+		pthread_mutex_lock(&plan->lock);
+		while (plan->next_write != c) {
+			pthread_cond_wait(&plan->written, &plan->lock);
+		}
+		if (fwrite(buf, 1, len, plan->outputfile) != len) {
+			__atomic_store_n(&plan->error, 1, __ATOMIC_RELAXED);
+		}
+		plan->next_write++;
+		pthread_cond_broadcast(&plan->written);
+		pthread_mutex_unlock(&plan->lock);
+	}
+
+	return NULL;
+}
+
+/*
+ * Matches the signals of the file to the checked columns of the template
+ * and works out the sensitivity the file was written with.
+ */
+static int plan_export(struct export_plan *plan, const struct edf_file *f,
+		const struct conv_template *tpl) {
+	char label[17];
+	double digmax = f->bdf ? 8388607.0 : 32767.0;
+	int c, j;
+
+	if (f->ns != tpl->edfsignals) {
+		printf("%s has %d signals, the template converts %d columns\n",
+				f->path, f->ns, tpl->edfsignals);
+		return 1;
+	}
+	if (f->bdf == tpl->edf_format) {
+		printf("Warning: %s is %s, the template is for %s\n", f->path,
+				f->bdf ? "BDF" : "EDF", tpl->edf_format ? "EDF" : "BDF");
+	}
+
+	for (c = 0; c < tpl->columns; c++) {
+		plan->signal[c] = -1;
+	}
+	for (j = 0; j < f->ns; j++) {
+		c = tpl->sigcolumn[j];
+		edf_label(f, j, label);
+		if (strncmp(label, tpl->signames[c], 16)) {
+			printf("Warning: signal %d of %s is %s, the template has %.16s\n",
+					j + 1, f->path, label, tpl->signames[c]);
+		}
+		plan->signal[c] = j;
+		/* in the order of physmax_finish() */
+		plan->sensitivity[j] = digmax / edf_physmax(f, j);
+		plan->sensitivity[j] *= tpl->multiplier[c];
+	}
+
+	return 0;
+}
+
+/* The label line and empty lines up to the template's startline */
+static void write_leading_lines(FILE *outputfile, const struct edf_file *f,
+		const struct conv_template *tpl, const struct export_plan *plan) {
+	char label[17];
+	int c, i;
+
+	if (tpl->startline < 2) {
+		return;
+	}
+
+	for (c = 0; c < tpl->columns; c++) {
+		if (c > 0) {
+			fputc(tpl->separator, outputfile);
+		}
+		if (plan->signal[c] >= 0) {
+			edf_label(f, plan->signal[c], label);
+			fputs(label, outputfile);
+		}
+	}
+	fputc('\n', outputfile);
+	for (i = 2; i < tpl->startline; i++) {
+		fputc('\n', outputfile);
+	}
+}
+
+static int export_file(const char *edfpath, const char *tplpath,
+		const char *csvpath, int workers) {
+	static struct conv_template tpl;
+	struct export_plan plan;
+	struct edf_file f;
+	struct export_worker *args;
+	pthread_t *threads;
+	size_t bufsize;
+	int i, n, error;
+
+	initSignalTable(&tpl);
+	if (!loadTemplate(tplpath, &tpl)) {
+		printf("\n");
+		return 1;
+	}
+
+	if (edf_map(&f, edfpath)) {
+		return 1;
+	}
+	if (edf_check_header(&f)) {
+		edf_unmap(&f);
+		return 1;
+	}
+
+	memset(&plan, 0, sizeof(plan));
+	plan.f = &f;
+	plan.tpl = &tpl;
+	if (plan_export(&plan, &f, &tpl)) {
+		edf_unmap(&f);
+		return 1;
+	}
+	plan.chunk_records = CHUNK_ROWS / f.smpls_per_block;
+	if (plan.chunk_records < 1) {
+		plan.chunk_records = 1;
+	}
+	plan.nchunks = (f.datarecords + plan.chunk_records - 1) / plan.chunk_records;
+	if (workers > plan.nchunks) {
+		workers = plan.nchunks > 0 ? (int) plan.nchunks : 1;
+	}
+
+	plan.outputfile = fopen(csvpath, "wb");
+	if (plan.outputfile == NULL) {
+		printf("Failed to open %s for writing\n", csvpath);
+		edf_unmap(&f);
+		return 1;
+	}
+	write_leading_lines(plan.outputfile, &f, &tpl, &plan);
+
+	threads = (pthread_t *) malloc(sizeof(pthread_t) * workers);
+	args = (struct export_worker *) calloc(workers,
+			sizeof(struct export_worker));
+	bufsize = (size_t) plan.chunk_records * f.smpls_per_block
+			* (tpl.columns * VALUE_CHARS + 1);
+	for (i = 0; args != NULL && i < workers; i++) {
+		args[i].plan = &plan;
+		args[i].buf = (char *) malloc(bufsize);
+		if (args[i].buf == NULL) {
+			break;
+		}
+	}
+	if (threads == NULL || args == NULL || i < workers) {
+		printf("Malloc error\n");
+		for (i = 0; args != NULL && i < workers; i++) {
+			free(args[i].buf);
+		}
+		free(args);
+		free(threads);
+		fclose(plan.outputfile);
+		edf_unmap(&f);
+		return 1;
+	}
+
+	madvise((void *) f.data, f.size, MADV_SEQUENTIAL);
+	pthread_mutex_init(&plan.lock, NULL);
+	pthread_cond_init(&plan.written, NULL);
+	for (n = 0; n < workers; n++) {
+		if (pthread_create(&threads[n], NULL, export_worker, &args[n])) {
+			break;
+		}
+	}
+	/* without any thread the chunks are formatted here */
+	if (n == 0) {
+		export_worker(&args[0]);
+	}
+	for (i = 0; i < n; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	pthread_cond_destroy(&plan.written);
+	pthread_mutex_destroy(&plan.lock);
+
+	for (i = 0; i < workers; i++) {
+		free(args[i].buf);
+	}
+	free(args);
+	free(threads);
+
+	error = plan.error;
+	if (fclose(plan.outputfile)) {
+		error = 1;
+	}
+	if (error) {
+		printf("Error writing output file\n");
+	}
+	edf_unmap(&f);
+
+	return error;
+}
+
+int main(int argc, char *argv[]) {
+	const char *args[3];
+	int i, n = 0, workers;
+
+	workers = sysconf(_SC_NPROCESSORS_ONLN);
+	for (i = 1; i < argc; i++) {
+		if (!strncmp(argv[i], "--jobs=", 7)) {
+			workers = atoi(argv[i] + 7);
+			if (workers < 1) {
+				n = 0;
+				break;
+			}
+		} else if (!strncmp(argv[i], "--", 2) || n == 3) {
+			n = 0;
+			break;
+		} else {
+			args[n++] = argv[i];
+		}
+	}
+
+	if (n != 3) {
+		printf("EDF and BDF to csv converter for files written by ascii2edf\n"
+				"Usage: edf2ascii [--jobs=<n>] <edf_file> <template_file> <csv_file>\n"
+				"  --jobs=<n>  threads formatting datarecords (default: number of cpus)\n"
+				"The template is the one the file was converted with.\n");
+		return 1;
+	}
+
+	return export_file(args[0], args[1], args[2], workers);
+}
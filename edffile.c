@@ -0,0 +1,236 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Reading the header of an EDF or BDF file.  The file is mapped rather
+ * than read, so that the datarecords can be scanned at memory speed.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#include "edffile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Reads a header field of n characters, trailing spaces allowed */
+static int field_double(const unsigned char *p, int n, double *value) {
+	char str[81], *end;
+
+	memcpy(str, p, n);
+	str[n] = 0;
+	*value = strtod(str, &end);
+	while (*end == ' ') {
+		end++;
+	}
+	return end == str || *end != 0;
+}
+
+static int field_integer(const unsigned char *p, int n, long long *value) {
+	char str[81], *end;
+
+	memcpy(str, p, n);
+	str[n] = 0;
+	*value = strtoll(str, &end, 10);
+	while (*end == ' ') {
+		end++;
+	}
+	return end == str || *end != 0;
+}
+
+/* The label of a signal with the trailing spaces removed */
+void edf_label(const struct edf_file *f, int j, char *label) {
+	int n = 16;
+
+	memcpy(label, f->data + 256 + 16 * j, 16);
+	while (n > 0 && label[n - 1] == ' ') {
+		n--;
+	}
+	label[n] = 0;
+}
+
+/*
+ * Checks the header and the file length and fills in f.  Prints what is
+ * wrong and returns 1 if anything is.
+ */
+int edf_check_header(struct edf_file *f) {
+	const unsigned char *h = f->data;
+	long long value, smpls, expected;
+	double physmin, physmax;
+	int i, j, ns, digmax;
+
+	if (f->size < 256) {
+		printf("%s: too short for an EDF header\n", f->path);
+		return 1;
+	}
+
+	if (!memcmp(h, "0       ", 8)) {
+		f->bdf = 0;
+	} else if (h[0] == 255 && !memcmp(h + 1, "BIOSEMI", 7)) {
+		f->bdf = 1;
+	} else {
+		printf("%s: not an EDF or BDF file\n", f->path);
+		return 1;
+	}
+	digmax = f->bdf ? 8388607 : 32767;
+
+	if (field_integer(h + 252, 4, &value) || value < 1 || value > 100000) {
+		printf("%s: invalid number of signals\n", f->path);
+		return 1;
+	}
+	f->ns = ns = (int) value;
+
+	if (field_integer(h + 184, 8, &value) || value != 256LL * ns + 256) {
+		printf("%s: header size is not %d for %d signals\n", f->path,
+				256 * ns + 256, ns);
+		return 1;
+	}
+	f->headersize = 256 * ns + 256;
+	if (f->size < f->headersize) {
+		printf("%s: the header is cut off\n", f->path);
+		return 1;
+	}
+
+	for (i = 8; i < f->headersize; i++) {
+		if (h[i] < 32 || h[i] > 126) {
+			printf("%s: character %d at header offset %d is not ASCII\n",
+					f->path, h[i], i);
+			return 1;
+		}
+	}
+
+	if (field_integer(h + 236, 8, &f->datarecords)) {
+		printf("%s: invalid number of datarecords\n", f->path);
+		return 1;
+	}
+	if (f->datarecords < 0) {
+		printf("%s: the number of datarecords was never written\n", f->path);
+		return 1;
+	}
+
+	if (field_double(h + 244, 8, &f->duration) || f->duration <= 0.0) {
+		printf("%s: invalid datarecord duration\n", f->path);
+		return 1;
+	}
+
+	/* signal fields: 16 label, 80 transducer, 8 dimension, then these */
+	h += 256 + 104 * ns;
+	for (j = 0; j < ns; j++) {
+		if (field_double(h + 8 * j, 8, &physmin)
+				|| field_double(h + 8 * (ns + j), 8, &physmax)
+				|| physmin >= physmax) {
+			printf("%s: invalid physical minimum or maximum of signal %d\n",
+					f->path, j + 1);
+			return 1;
+		}
+		if (field_integer(h + 8 * (2 * ns + j), 8, &value)
+				|| value != -digmax - 1) {
+			printf("%s: digital minimum of signal %d is not %d\n", f->path,
+					j + 1, -digmax - 1);
+			return 1;
+		}
+		if (field_integer(h + 8 * (3 * ns + j), 8, &value) || value != digmax) {
+			printf("%s: digital maximum of signal %d is not %d\n", f->path,
+					j + 1, digmax);
+			return 1;
+		}
+		/* 80 prefiltering, then the samples per datarecord */
+		if (field_integer(h + 112 * ns + 8 * j, 8, &smpls) || smpls < 1
+				|| smpls > 1000000000) {
+			printf("%s: invalid samples per datarecord of signal %d\n",
+					f->path, j + 1);
+			return 1;
+		}
+		if (j == 0) {
+			f->smpls_per_block = (int) smpls;
+		} else if (smpls != f->smpls_per_block) {
+			printf("%s: samples per datarecord of signal %d differ from the first\n",
+					f->path, j + 1);
+			return 1;
+		}
+	}
+
+	f->recordsize = (long long) ns * f->smpls_per_block * (f->bdf ? 3 : 2);
+	expected = f->headersize + f->datarecords * f->recordsize;
+	if (f->size != expected) {
+		printf("%s: %lld bytes, the header and %lld datarecords make %lld\n",
+				f->path, f->size, f->datarecords, expected);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* The physical maximum of signal j, after edf_check_header() */
+double edf_physmax(const struct edf_file *f, int j) {
+	double physmax = 0.0;
+
+	field_double(f->data + 256 + 104 * f->ns + 8 * (f->ns + j), 8, &physmax);
+	return physmax;
+}
+
+/* Maps the file at path.  Prints what is wrong and returns 1 on failure. */
+int edf_map(struct edf_file *f, const char *path) {
+	struct stat st;
+	int fd;
+
+	memset(f, 0, sizeof(struct edf_file));
+	f->path = path;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		printf("%s: can not open\n", path);
+		if (fd >= 0) {
+			close(fd);
+		}
+		return 1;
+	}
+	f->size = st.st_size;
+	if (f->size == 0) {
+		close(fd);
+		printf("%s: empty file\n", path);
+		return 1;
+	}
+
+	f->data = (const unsigned char *) mmap(NULL, f->size, PROT_READ,
+			MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (f->data == MAP_FAILED) {
+		printf("%s: can not map\n", path);
+		return 1;
+	}
+
+	return 0;
+}
+
+void edf_unmap(struct edf_file *f) {
+	munmap((void *) f->data, f->size);
+}
@@ -0,0 +1,58 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * EDF and BDF files as ascii2edf writes them, mapped into memory: all
+ * signals have the same number of samples per datarecord and the digital
+ * range of the format.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#ifndef edffile_INCLUDED
+#define edffile_INCLUDED
+
+struct edf_file {
+	const char *path;
+	const unsigned char *data;
+	long long size;
+	int bdf;
+	int ns;
+	int headersize;
+	long long datarecords;
+	double duration;
+	int smpls_per_block;
+	long long recordsize;
+};
+
+int edf_map(struct edf_file *f, const char *path);
+int edf_check_header(struct edf_file *f);
+double edf_physmax(const struct edf_file *f, int j);
+void edf_label(const struct edf_file *f, int j, char *label);
+void edf_unmap(struct edf_file *f);
+
+#endif
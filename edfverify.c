@@ -0,0 +1,228 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Verifies EDF and BDF files written by ascii2edf without reading them
+ * into memory: the file is mapped, the header fields are checked against
+ * what write_header() produces and the file length against the datarecord
+ * count.  With --saturation every sample is compared with the digital
+ * minimum and maximum, 8 EDF samples at a time with SSE2.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#include "edffile.h"
+#include "hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Samples at the digital minimum or maximum among n EDF samples */
+static long long saturated_edf(const unsigned char *p, int n) {
+	long long count = 0;
+	int i = 0, k;
+	short v;
+#if defined(__SSE2__)
+	const __m128i lo = _mm_set1_epi16(-32768), hi = _mm_set1_epi16(32767),
+			one = _mm_set1_epi16(1);
+	__m128i acc, x;
+
+	while (i + 8 <= n) {
+		/* the 16 bit lanes are summed before they can overflow */
+		acc = _mm_setzero_si128();
+		for (k = 0; k < 4096 && i + 8 <= n; k++, i += 8) {
+			x = _mm_loadu_si128((const __m128i *) (p + 2 * i));
+			acc = _mm_sub_epi16(acc, _mm_or_si128(_mm_cmpeq_epi16(x, lo),
+					_mm_cmpeq_epi16(x, hi)));
+		}
+		acc = _mm_madd_epi16(acc, one);
+		acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4e));
+		acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xb1));
+		count += _mm_cvtsi128_si32(acc);
+	}
+#endif
+	for (; i < n; i++) {
+		v = (short) (p[2 * i] | (p[2 * i + 1] << 8));
+		count += v == -32768 || v == 32767;
+	}
+
+	return count;
+}
+
+/*
+ * Same as saturated_edf() for BDF samples.  With SSE2, 16 bytes at a time
+ * are compared with the bytes of both limits and the masks shifted so that
+ * the first byte of a sample carries the result for all three; 5 samples
+ * are done per load.
+ */
+static long long saturated_bdf(const unsigned char *p, int n) {
+	long long count = 0;
+	int i = 0, v;
+#if defined(__SSE2__)
+	const __m128i ff = _mm_set1_epi8((char) 0xff), zero = _mm_setzero_si128(),
+			x7f = _mm_set1_epi8(0x7f), x80 = _mm_set1_epi8((char) 0x80);
+	unsigned int ones, zeros, hi, lo;
+	__m128i x;
+
+	/* a load must stay within the 3 * n bytes */
+	for (; i + 6 <= n; i += 5, p += 15) {
+		x = _mm_loadu_si128((const __m128i *) p);
+		ones = _mm_movemask_epi8(_mm_cmpeq_epi8(x, ff));
+		zeros = _mm_movemask_epi8(_mm_cmpeq_epi8(x, zero));
+		hi = ones & (ones >> 1)
+				& (_mm_movemask_epi8(_mm_cmpeq_epi8(x, x7f)) >> 2);
+		lo = zeros & (zeros >> 1)
+				& (_mm_movemask_epi8(_mm_cmpeq_epi8(x, x80)) >> 2);
+		/* the flags are 3 bits apart, the product sums them in bits 12-14 */
+		count += ((((hi | lo) & 0x1249) * 0x1249) >> 12) & 7;
+	}
+#endif
+	for (; i < n; i++, p += 3) {
+		v = p[0] | (p[1] << 8) | (p[2] << 16);
+		count += (v == 0x7fffff) | (v == 0x800000);
+	}
+
+	return count;
+}
+
+/* Counts the saturated samples of every signal over all datarecords */
+static void scan_saturation(const struct edf_file *f, long long *counts) {
+	const unsigned char *record = f->data + f->headersize;
+	const int n = f->smpls_per_block, block = n * (f->bdf ? 3 : 2);
+	long long r;
+	int j;
+
+	madvise((void *) f->data, f->size, MADV_SEQUENTIAL);
+	for (r = 0; r < f->datarecords; r++, record += f->recordsize) {
+		for (j = 0; j < f->ns; j++) {
+			counts[j] += f->bdf ? saturated_bdf(record + j * block, n)
+					: saturated_edf(record + j * block, n);
+		}
+	}
+}
+
+/*
+ * Prints the line ascii2edf --hash writes to <file>.hash: the digest of the
+ * datarecords followed by the header.
+ */
+static void print_hash(const struct edf_file *f, int algorithm) {
+	struct output_hash h;
+	char hex[HASH_HEX_LENGTH];
+	const char *name;
+
+	madvise((void *) f->data, f->size, MADV_SEQUENTIAL);
+	hash_init(&h, algorithm);
+	hash_update(&h, f->data + f->headersize, f->size - f->headersize);
+	hash_update(&h, f->data, f->headersize);
+	hash_final(&h, hex);
+
+	name = strrchr(f->path, '/');
+	printf("%s %s %s\n", hash_label(algorithm), hex,
+			name != NULL ? name + 1 : f->path);
+}
+
+/* Verifies one file.  Returns 0 if it is correct. */
+static int verify(const char *path, int saturation, int hash) {
+	struct edf_file f;
+	long long *counts;
+	char label[17];
+	int j, result;
+
+	if (edf_map(&f, path)) {
+		return 1;
+	}
+
+	result = edf_check_header(&f);
+	if (!result) {
+		printf("%s: ok, %s, %d signals, %lld datarecords of %d samples\n",
+				path, f.bdf ? "BDF" : "EDF", f.ns, f.datarecords,
+				f.smpls_per_block);
+	}
+
+	if (!result && hash) {
+		print_hash(&f, hash);
+	}
+
+	if (!result && saturation) {
+		counts = (long long *) calloc(f.ns, sizeof(long long));
+		if (counts == NULL) {
+			printf("Malloc error\n");
+			result = 1;
+		} else {
+			scan_saturation(&f, counts);
+			printf("saturated samples per signal:\n");
+			for (j = 0; j < f.ns; j++) {
+				edf_label(&f, j, label);
+				printf("  %-16s %lld\n", label, counts[j]);
+			}
+			free(counts);
+		}
+	}
+
+	edf_unmap(&f);
+
+	return result;
+}
+
+int main(int argc, char *argv[]) {
+	int i, saturation = 0, hash = HASH_NONE, files = 0, failed = 0;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--saturation")) {
+			saturation = 1;
+		} else if (!strncmp(argv[i], "--hash=", 7)
+				&& hash_algorithm(argv[i] + 7) > 0) {
+			hash = hash_algorithm(argv[i] + 7);
+		} else if (!strncmp(argv[i], "--", 2)) {
+			files = 0;
+			break;
+		} else {
+			files++;
+		}
+	}
+
+	if (files == 0) {
+		printf("EDF and BDF verifier for files written by ascii2edf\n"
+				"Usage: edfverify [--saturation] [--hash=sha256|xxh64] <file>...\n"
+				"  --saturation  count the samples at the digital minimum or maximum\n"
+				"  --hash=<alg>  print the digest ascii2edf --hash writes to <file>.hash\n"
+				"Exits with 1 if any file is not correct.\n");
+		return 1;
+	}
+
+	for (i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--", 2)) {
+			failed |= verify(argv[i], saturation, hash);
+		}
+	}
+
+	return failed;
+}
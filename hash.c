@@ -0,0 +1,324 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * SHA-256 (FIPS 180-4) and XXH64, both fed in blocks of 64 bytes, of which
+ * XXH64 takes two stripes of 32 at a time.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#include "hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const unsigned int sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+	0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+	0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+	0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+#define XXH_PRIME1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME3 0x165667B19E3779F9ULL
+#define XXH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME5 0x27D4EB2F165667C5ULL
+
+static inline unsigned int ror32(unsigned int x, int n) {
+	return (x >> n) | (x << (32 - n));
+}
+
+static inline unsigned long long rol64(unsigned long long x, int n) {
+	return (x << n) | (x >> (64 - n));
+}
+
+static inline unsigned long long load64(const unsigned char *p) {
+	unsigned long long x;
+
+	memcpy(&x, p, 8); /* little endian machines only, as the EDF writer */
+	return x;
+}
+
+static void sha256_block(unsigned int *state, const unsigned char *p) {
+	unsigned int w[64], s[8], t1, t2;
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		w[i] = (unsigned int) p[4 * i] << 24 | p[4 * i + 1] << 16
+				| p[4 * i + 2] << 8 | p[4 * i + 3];
+	}
+	for (; i < 64; i++) {
+		w[i] = w[i - 16] + w[i - 7]
+				+ (ror32(w[i - 15], 7) ^ ror32(w[i - 15], 18) ^ (w[i - 15] >> 3))
+				+ (ror32(w[i - 2], 17) ^ ror32(w[i - 2], 19) ^ (w[i - 2] >> 10));
+	}
+
+	memcpy(s, state, sizeof(s));
+	for (i = 0; i < 64; i++) {
+		t1 = s[7] + (ror32(s[4], 6) ^ ror32(s[4], 11) ^ ror32(s[4], 25))
+				+ ((s[4] & s[5]) ^ (~s[4] & s[6])) + sha256_k[i] + w[i];
+		t2 = (ror32(s[0], 2) ^ ror32(s[0], 13) ^ ror32(s[0], 22))
+				+ ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+		memmove(s + 1, s, sizeof(unsigned int) * 7);
+		s[4] += t1;
+		s[0] = t1 + t2;
+	}
+	for (i = 0; i < 8; i++) {
+		state[i] += s[i];
+	}
+}
+
+static inline unsigned long long xxh64_round(unsigned long long acc,
+		unsigned long long input) {
+	return rol64(acc + input * XXH_PRIME2, 31) * XXH_PRIME1;
+}
+
+static inline unsigned long long xxh64_merge(unsigned long long acc,
+		unsigned long long v) {
+	return (acc ^ xxh64_round(0, v)) * XXH_PRIME1 + XXH_PRIME4;
+}
+
+/* One stripe of 32 bytes */
+static void xxh64_stripe(unsigned long long *v, const unsigned char *p) {
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		v[i] = xxh64_round(v[i], load64(p + 8 * i));
+	}
+}
+
+static void hash_block(struct output_hash *h, const unsigned char *p) {
+	if (h->algorithm == HASH_SHA256) {
+		sha256_block(h->sha256, p);
+	} else {
+		xxh64_stripe(h->xxh64, p);
+		xxh64_stripe(h->xxh64, p + 32);
+	}
+}
+
+/* HASH_SHA256 or HASH_XXH64 for their names, -1 for any other */
+int hash_algorithm(const char *name) {
+	if (!strcmp(name, "sha256")) {
+		return HASH_SHA256;
+	}
+	if (!strcmp(name, "xxh64")) {
+		return HASH_XXH64;
+	}
+	return -1;
+}
+
+const char *hash_name(int algorithm) {
+	return algorithm == HASH_SHA256 ? "sha256" : "xxh64";
+}
+
+/*
+ * The name of the digest in <output>.hash, which says what it covers: not
+ * the file as sha256sum or xxhsum read it, but the datarecords followed by
+ * the header.
+ */
+const char *hash_label(int algorithm) {
+	return algorithm == HASH_SHA256 ? "sha256-records+header"
+			: "xxh64-records+header";
+}
+
+void hash_init(struct output_hash *h, int algorithm) {
+	static const unsigned int sha256_iv[8] = { 0x6a09e667, 0xbb67ae85,
+			0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab,
+			0x5be0cd19 };
+
+	memset(h, 0, sizeof(struct output_hash));
+	h->algorithm = algorithm;
+	memcpy(h->sha256, sha256_iv, sizeof(sha256_iv));
+	/* seed 0 */
+	h->xxh64[0] = XXH_PRIME1 + XXH_PRIME2;
+	h->xxh64[1] = XXH_PRIME2;
+	h->xxh64[2] = 0;
+	h->xxh64[3] = 0 - XXH_PRIME1;
+}
+
+void hash_update(struct output_hash *h, const void *data, size_t n) {
+	const unsigned char *p = (const unsigned char *) data;
+	size_t m;
+
+	h->length += n;
+	if (h->fill > 0) {
+		m = n < (size_t) (64 - h->fill) ? n : 64 - h->fill;
+		memcpy(h->block + h->fill, p, m);
+		h->fill += m;
+		p += m;
+		n -= m;
+		if (h->fill < 64) {
+			return;
+		}
+		hash_block(h, h->block);
+		h->fill = 0;
+	}
+
+	for (; n >= 64; n -= 64, p += 64) {
+		hash_block(h, p);
+	}
+	memcpy(h->block, p, n);
+	h->fill = n;
+}
+
+static void sha256_final(struct output_hash *h, char *hex) {
+	unsigned char pad[72];
+	unsigned long long bits = h->length * 8;
+	int i, n;
+
+	/* 0x80, zeros up to 56 bytes mod 64, the length in bits big endian */
+	n = (h->fill < 56 ? 56 : 120) - h->fill;
+	memset(pad, 0, sizeof(pad));
+	pad[0] = 0x80;
+	for (i = 0; i < 8; i++) {
+		pad[n + i] = (unsigned char) (bits >> (56 - 8 * i));
+	}
+	hash_update(h, pad, n + 8);
+
+	for (i = 0; i < 8; i++) {
+		sprintf(hex + 8 * i, "%08x", h->sha256[i]);
+	}
+}
+
+static void xxh64_final(struct output_hash *h, char *hex) {
+	unsigned long long *v = h->xxh64, acc;
+	const unsigned char *p = h->block;
+	int n = h->fill;
+
+	/* a whole stripe in the partial block still goes to the accumulators */
+	if (n >= 32) {
+		xxh64_stripe(v, p);
+		p += 32;
+		n -= 32;
+	}
+
+	if (h->length >= 32) {
+		acc = rol64(v[0], 1) + rol64(v[1], 7) + rol64(v[2], 12)
+				+ rol64(v[3], 18);
+		acc = xxh64_merge(acc, v[0]);
+		acc = xxh64_merge(acc, v[1]);
+		acc = xxh64_merge(acc, v[2]);
+		acc = xxh64_merge(acc, v[3]);
+	} else {
+		acc = XXH_PRIME5;
+	}
+	acc += h->length;
+
+	for (; n >= 8; n -= 8, p += 8) {
+		acc ^= xxh64_round(0, load64(p));
+		acc = rol64(acc, 27) * XXH_PRIME1 + XXH_PRIME4;
+	}
+	if (n >= 4) {
+		acc ^= (unsigned long long) (p[0] | p[1] << 8 | p[2] << 16
+				| (unsigned int) p[3] << 24) * XXH_PRIME1;
+		acc = rol64(acc, 23) * XXH_PRIME2 + XXH_PRIME3;
+		n -= 4;
+		p += 4;
+	}
+	for (; n > 0; n--, p++) {
+		acc ^= *p * XXH_PRIME5;
+		acc = rol64(acc, 11) * XXH_PRIME1;
+	}
+
+	acc ^= acc >> 33;
+	acc *= XXH_PRIME2;
+	acc ^= acc >> 29;
+	acc *= XXH_PRIME3;
+	acc ^= acc >> 32;
+
+	sprintf(hex, "%016llx", acc);
+}
+
+/* Finishes the digest into hex, HASH_HEX_LENGTH characters at most */
+void hash_final(struct output_hash *h, char *hex) {
+	if (h->algorithm == HASH_SHA256) {
+		sha256_final(h, hex);
+	} else {
+		xxh64_final(h, hex);
+	}
+}
+
+/*
+ * Adds the header of the finished file at path to h and writes
+ * "<label> <digest> <file name>" to <path>.hash, see hash_label(), the
+ * line edfverify --hash prints for the file.  Returns 0 on success.
+ */
+int hash_file(struct output_hash *h, const char *path) {
+	char sidecar[4096], hex[HASH_HEX_LENGTH], field[5], *header;
+	const char *name;
+	int headersize;
+	FILE *f;
+
+	f = fopen(path, "rb");
+	if (f == NULL || fseek(f, 252, SEEK_SET) || fread(field, 4, 1, f) != 1) {
+		printf("Error: Can not read the header of %s", path);
+		if (f != NULL) {
+			fclose(f);
+		}
+		return 1;
+	}
+	field[4] = 0;
+	headersize = 256 * (atoi(field) + 1);
+
+	header = (char *) malloc(headersize);
+	if (header == NULL || fseek(f, 0, SEEK_SET)
+			|| fread(header, headersize, 1, f) != 1) {
+		printf("Error: Can not read the header of %s", path);
+		free(header);
+		fclose(f);
+		return 1;
+	}
+	fclose(f);
+
+	hash_update(h, header, headersize);
+	free(header);
+	hash_final(h, hex);
+
+	name = strrchr(path, '/');
+	name = name != NULL ? name + 1 : path;
+	snprintf(sidecar, sizeof(sidecar), "%s.hash", path);
+	f = fopen(sidecar, "w");
+	if (f == NULL) {
+		printf("Can not open file %s for writing.", sidecar);
+		return 1;
+	}
+	fprintf(f, "%s %s %s\n", hash_label(h->algorithm), hex, name);
+	if (fclose(f)) {
+		printf("Error: A write error occurred.");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Content hash of an output file, computed while it is written.  The
+ * number of datarecords in the header is only known at the end, so the
+ * datarecords are hashed as they are written and the header after them:
+ * the digest is that of the datarecords followed by the header.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#ifndef hash_INCLUDED
+#define hash_INCLUDED
+
+#include <stddef.h>
+
+#define HASH_NONE 0
+#define HASH_SHA256 1
+#define HASH_XXH64 2
+
+/* Hex digits of the longest digest and the terminating 0 */
+#define HASH_HEX_LENGTH 65
+
+struct output_hash {
+	int algorithm;
+	unsigned long long length; /* bytes hashed */
+	unsigned int sha256[8];
+	unsigned long long xxh64[4];
+	unsigned char block[64]; /* the bytes of a partial block */
+	int fill;
+};
+
+int hash_algorithm(const char *name);
+const char *hash_name(int algorithm);
+const char *hash_label(int algorithm);
+void hash_init(struct output_hash *h, int algorithm);
+void hash_update(struct output_hash *h, const void *data, size_t n);
+void hash_final(struct output_hash *h, char *hex);
+int hash_file(struct output_hash *h, const char *filename);
+
+#endif
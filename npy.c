@@ -0,0 +1,388 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * NumPy array input.  The file is mapped and read through a stdio stream
+ * which presents the array row after row, so the conversion reads it like
+ * any binary file.  A C order array is the file as it is; a Fortran order
+ * one is put together a row at a time from one place in every column,
+ * each of which is read front to back.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#include "npy.h"
+#include "convert.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define NPY_MAGIC "\x93NUMPY"
+#define ZIP_MAGIC "PK\x03\x04"
+#define ZIP_HEADER 30 /* bytes of a local file header before the name */
+
+static unsigned int le16(const unsigned char *p) {
+	return p[0] | p[1] << 8;
+}
+
+static unsigned int le32(const unsigned char *p) {
+	return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int) p[3] << 24;
+}
+
+/* The text after the key of the header dictionary, NULL if it has none */
+static const char *header_value(const char *header, const char *key) {
+	const char *p = strstr(header, key);
+
+	if (p == NULL || (p = strchr(p + strlen(key), ':')) == NULL) {
+		return NULL;
+	}
+	for (p++; *p == ' '; p++)
+		;
+	return p;
+}
+
+/*
+ * Reads the descr, fortran_order and shape of the header dictionary, such
+ * as {'descr': '<f8', 'fortran_order': False, 'shape': (1000, 4), }.
+ */
+static int parse_header(const char *path, const char *header,
+		struct npy_array *a) {
+	const char *p;
+	char descr[8];
+	long long shape[3];
+	int i, n;
+
+	p = header_value(header, "'descr'");
+	if (p == NULL || (*p != '\'' && *p != '"')) {
+		printf("Error: %s has no descr in its header.", path);
+		return 1;
+	}
+	for (i = 0, p++; *p && *p != '\'' && *p != '"' && i < 7; i++) {
+		descr[i] = *p++;
+	}
+	descr[i] = '\0';
+
+	if (descr[0] == '>') {
+		a->big_endian = 1;
+	} else if (descr[0] == '=') {
+		a->big_endian = __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__;
+	} else if (descr[0] != '<') {
+		a->big_endian = -1;
+	}
+	if (a->big_endian >= 0 && !strcmp(descr + 1, "i2")) {
+		a->type = BINARY_INT16;
+	} else if (a->big_endian >= 0 && !strcmp(descr + 1, "i4")) {
+		a->type = BINARY_INT32;
+	} else if (a->big_endian >= 0 && !strcmp(descr + 1, "f4")) {
+		a->type = BINARY_FLOAT32;
+	} else if (a->big_endian >= 0 && !strcmp(descr + 1, "f8")) {
+		a->type = BINARY_FLOAT64;
+	} else {
+		printf("Error: %s holds %s samples, only int16, int32, float32 and"
+				" float64 are read.", path, descr);
+		return 1;
+	}
+
+	p = header_value(header, "'fortran_order'");
+	if (p == NULL || (strncmp(p, "True", 4) && strncmp(p, "False", 5))) {
+		printf("Error: %s has no fortran_order in its header.", path);
+		return 1;
+	}
+	a->fortran_order = *p == 'T';
+
+	p = header_value(header, "'shape'");
+	if (p == NULL || *p != '(') {
+		printf("Error: %s has no shape in its header.", path);
+		return 1;
+	}
+	for (n = 0, p++; n < 3; n++) {
+		for (; *p == ' '; p++)
+			;
+		if (*p < '0' || *p > '9') {
+			break;
+		}
+		shape[n] = strtoll(p, (char **) &p, 10);
+		for (; *p == ' '; p++)
+			;
+		if (*p == ',') {
+			p++;
+		}
+	}
+	if (*p != ')' || n < 1 || n > 2 || (n == 2 && (shape[1] < 1
+			|| shape[1] > MAX_COLUMNS))) {
+		printf("Error: %s is not an array of samples by channels.", path);
+		return 1;
+	}
+	a->rows = shape[0];
+	a->columns = n == 2 ? (int) shape[1] : 1;
+
+	return 0;
+}
+
+/*
+ * Reads the header of the .npy file at path, or of the first array of the
+ * .npz archive at path.  Returns 0 if it is one, with the array in *a, 1
+ * if the file is not a NumPy file and -1 on errors, which are printed.
+ */
+int npy_probe(const char *path, struct npy_array *a) {
+	unsigned char head[ZIP_HEADER];
+	char *header;
+	long long base = 0, length, size;
+	int fd, version, error;
+	struct stat st;
+
+	memset(a, 0, sizeof(struct npy_array));
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return 1;
+	}
+	if (fstat(fd, &st) || pread(fd, head, ZIP_HEADER, 0) != ZIP_HEADER) {
+		close(fd);
+		return 1;
+	}
+
+	/* numpy.savez stores its arrays uncompressed, each one a .npy file */
+	if (!memcmp(head, ZIP_MAGIC, 4)) {
+		if (le16(head + 8) != 0 || (le16(head + 6) & 1)) {
+			printf("Error: %s is compressed or encrypted, only archives of"
+					" numpy.savez are read.", path);
+			close(fd);
+			return -1;
+		}
+		base = ZIP_HEADER + le16(head + 26) + le16(head + 28);
+		if (pread(fd, head, 12, base) != 12 || memcmp(head, NPY_MAGIC, 6)) {
+			printf("Error: %s does not start with a .npy array.", path);
+			close(fd);
+			return -1;
+		}
+	} else if (memcmp(head, NPY_MAGIC, 6)) {
+		close(fd);
+		return 1;
+	}
+
+	version = head[6];
+	if (version == 1) {
+		length = le16(head + 8);
+		a->offset = base + 10 + length;
+	} else {
+		length = le32(head + 8);
+		a->offset = base + 12 + length;
+	}
+	if (version < 1 || version > 3 || a->offset > st.st_size) {
+		printf("Error: %s has a .npy header of version %d.%d which is not"
+				" read.", path, head[6], head[7]);
+		close(fd);
+		return -1;
+	}
+
+	header = (char *) malloc(length + 1);
+	if (header == NULL) {
+		printf("Critical error: Malloc error (npy header)");
+		close(fd);
+		return -1;
+	}
+	error = pread(fd, header, length, a->offset - length) != length;
+	close(fd);
+	header[error ? 0 : length] = '\0';
+	error = error || parse_header(path, header, a);
+	free(header);
+	if (error) {
+		return -1;
+	}
+
+	size = a->type == BINARY_INT16 ? 2 : a->type == BINARY_FLOAT64 ? 8 : 4;
+	a->end = a->offset + a->rows * a->columns * size;
+	if (a->end > st.st_size) {
+		printf("Error: %s is shorter than its array of %lld by %d samples.",
+				path, a->rows, a->columns);
+		return -1;
+	}
+
+	return 0;
+}
+
+struct npy_stream {
+	const char *map;
+	size_t map_size;
+	struct npy_array a;
+	int size; /* of a sample */
+	long long pos;
+};
+
+/* Whole rows from row on of a Fortran order array into buf[0, n) */
+template<int Size>
+static size_t copy_rows(const struct npy_stream *s, char *buf, size_t n,
+		long long row) {
+	const char *data = s->map + s->a.offset + row * Size;
+	const long long stride = s->a.rows * Size;
+	const size_t rowsize = (size_t) Size * s->a.columns;
+	size_t done;
+	int c;
+
+	for (done = 0; done + rowsize <= n; data += Size) {
+		for (c = 0; c < s->a.columns; c++, done += Size) {
+			memcpy(buf + done, data + c * stride, Size);
+		}
+	}
+	return done;
+}
+
+/* Bytes from pos of the rows of a Fortran order array */
+static void read_rows(const struct npy_stream *s, char *buf, size_t n,
+		long long pos) {
+	const long long rowsize = (long long) s->size * s->a.columns;
+	const long long v = pos - s->a.offset;
+	const char *data = s->map + s->a.offset;
+	long long row = v / rowsize;
+	int c = (int) (v % rowsize / s->size), b = (int) (v % s->size), k;
+	size_t done = 0;
+
+	while (done < n) {
+		if (c == 0 && b == 0 && (long long) (n - done) >= rowsize) {
+			switch (s->size) {
+			case 2:
+				k = copy_rows<2>(s, buf + done, n - done, row);
+				break;
+			case 4:
+				k = copy_rows<4>(s, buf + done, n - done, row);
+				break;
+			default:
+				k = copy_rows<8>(s, buf + done, n - done, row);
+				break;
+			}
+			done += k;
+			row += k / rowsize;
+			continue;
+		}
+
+		k = s->size - b;
+		if ((size_t) k > n - done) {
+			k = (int) (n - done);
+		}
+		memcpy(buf + done, data + (c * s->a.rows + row) * s->size + b, k);
+		done += k;
+		b = 0;
+		if (++c == s->a.columns) {
+			c = 0;
+			row++;
+		}
+	}
+}
+
+static ssize_t npy_read(void *cookie, char *buf, size_t n) {
+	struct npy_stream *s = (struct npy_stream *) cookie;
+	size_t head = 0;
+
+	if (s->pos >= s->a.end) {
+		return 0;
+	}
+	if ((long long) n > s->a.end - s->pos) {
+		n = s->a.end - s->pos;
+	}
+
+	/* the header, and a C order array, are read as they are in the file */
+	if (!s->a.fortran_order || s->pos < s->a.offset) {
+		head = s->a.fortran_order && s->a.offset - s->pos < (long long) n ?
+				s->a.offset - s->pos : n;
+		memcpy(buf, s->map + s->pos, head);
+	}
+	if (head < n) {
+		read_rows(s, buf + head, n - head, s->pos + head);
+	}
+
+	s->pos += n;
+	return n;
+}
+
+static int npy_seek(void *cookie, off64_t *offset, int whence) {
+	struct npy_stream *s = (struct npy_stream *) cookie;
+
+	if (whence == SEEK_SET) {
+		s->pos = *offset;
+	} else if (whence == SEEK_CUR) {
+		s->pos += *offset;
+	} else {
+		s->pos = s->a.end + *offset;
+	}
+	if (s->pos < 0) {
+		s->pos = 0;
+	}
+
+	*offset = s->pos;
+	return 0;
+}
+
+static int npy_close(void *cookie) {
+	struct npy_stream *s = (struct npy_stream *) cookie;
+
+	munmap((void *) s->map, s->map_size);
+	free(s);
+	return 0;
+}
+
+/*
+ * Opens the array a of the file at path for reading as a stream of rows:
+ * the bytes before a->offset as in the file, then every sample of the
+ * first row, of the second and so on.  Returns NULL on errors.
+ */
+FILE *npy_open(const char *path, const struct npy_array *a) {
+	cookie_io_functions_t io = { npy_read, NULL, npy_seek, npy_close };
+	struct npy_stream *s;
+	FILE *file;
+	void *map;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	map = mmap(NULL, (size_t) a->end, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+	madvise(map, (size_t) a->end, MADV_SEQUENTIAL);
+
+	s = (struct npy_stream *) calloc(1, sizeof(struct npy_stream));
+	if (s == NULL) {
+		munmap(map, (size_t) a->end);
+		return NULL;
+	}
+	s->map = (const char *) map;
+	s->map_size = (size_t) a->end;
+	s->a = *a;
+	s->size = a->type == BINARY_INT16 ? 2 : a->type == BINARY_FLOAT64 ? 8 : 4;
+
+	file = fopencookie(s, "rb", io);
+	if (file == NULL) {
+		npy_close(s);
+	}
+	return file;
+}
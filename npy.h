@@ -0,0 +1,54 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * NumPy arrays as input: .npy files, and the first array of an .npz
+ * archive written by numpy.savez.  The array is read as binary rows, the
+ * layout of the template binary element taken from the .npy header.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#ifndef npy_INCLUDED
+#define npy_INCLUDED
+
+#include <stdio.h>
+
+struct npy_array {
+	int type; /* BINARY_* sample type, BINARY_NONE if not an array */
+	int big_endian;
+	int fortran_order; /* stored column after column */
+	long long rows; /* samples */
+	int columns; /* channels, 1 for a 1-D array */
+	long long offset; /* of the first sample in the file */
+	long long end; /* offset of the byte after the last sample */
+};
+
+int npy_probe(const char *path, struct npy_array *a);
+FILE *npy_open(const char *path, const struct npy_array *a);
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Machine readable progress reports for --progress-fd and
+ * --progress-socket.  Every line is a JSON object like
+ *
+ *  {"status":"running","phase":"convert","pass":2,"passes":2,
+ *   "bytes":1048576,"total_bytes":4194304,"rows":16384,"datarecords":64,
+ *   "mb_per_s":52.1,"eta_s":3.2,"elapsed_s":4.0}
+ *
+ * where bytes and rows count the current pass.  With a row index the lines
+ * also have "total_rows" and "total_datarecords".  The last line has status
+ * "done" or "error".
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#include "progress.h"
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static double monotonic(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void progress_init(struct conv_progress *progress) {
+	memset(progress, 0, sizeof(*progress));
+	progress->fd = -1;
+	progress->interval_ms = 1000;
+	progress->passes = 1;
+	progress->total_rows = -1;
+	progress->total_datarecords = -1;
+	progress->phase = "start";
+	progress->pass = 1;
+}
+
+int progress_open_socket(struct conv_progress *progress, const char *path) {
+	struct sockaddr_un addr;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		return 1;
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return 1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+		close(fd);
+		return 1;
+	}
+
+	progress->fd = fd;
+	progress->owned = 1;
+	return 0;
+}
+
+/*
+ * Writes one report.  last_bytes and last_time carry the previous sample so
+ * the throughput reflects the current rate rather than the average.
+ */
+static void emit(struct conv_progress *progress, const char *status,
+		long long *last_done, double *last_time) {
+	char line[512], totals[128] = "";
+	const char *phase;
+	int len, pass, datarecords;
+	long long bytes, rows, done, total;
+	double t, rate, eta;
+
+	phase = __atomic_load_n(&progress->phase, __ATOMIC_ACQUIRE);
+	pass = __atomic_load_n(&progress->pass, __ATOMIC_RELAXED);
+	bytes = __atomic_load_n(&progress->bytes, __ATOMIC_RELAXED);
+	rows = __atomic_load_n(&progress->rows, __ATOMIC_RELAXED);
+	datarecords = __atomic_load_n(&progress->datarecords, __ATOMIC_RELAXED);
+
+	t = monotonic();
+	done = (pass - 1) * progress->total_bytes + bytes;
+	total = progress->passes * progress->total_bytes;
+	rate = t > *last_time ? (done - *last_done) / (t - *last_time) : 0.0;
+	eta = rate > 0.0 ? (total - done) / rate : -1.0;
+	if (eta < 0.0 && done >= total) {
+		eta = 0.0;
+	}
+	*last_done = done;
+	*last_time = t;
+
+	if (progress->total_rows >= 0) {
+		snprintf(totals, sizeof(totals),
+				"\"total_rows\":%lld,\"total_datarecords\":%lld,",
+				progress->total_rows, progress->total_datarecords);
+	}
+
+	len = snprintf(line, sizeof(line), "{\"status\":\"%s\",\"phase\":\"%s\","
+			"\"pass\":%d,\"passes\":%d,\"bytes\":%lld,\"total_bytes\":%lld,"
+			"\"rows\":%lld,\"datarecords\":%d,%s\"mb_per_s\":%.3f,"
+			"\"eta_s\":%.1f,\"elapsed_s\":%.1f}\n", status, phase, pass,
+			progress->passes, bytes, progress->total_bytes, rows, datarecords,
+			totals, rate / 1e6, eta, t - progress->start);
+
+	if (write(progress->fd, line, len) != len) {
+		/* the listener went away, there is nobody left to report to */
+		progress->stop = 1;
+	}
+}
+
+static void *reporter(void *arg) {
+	struct conv_progress *progress = (struct conv_progress *) arg;
+	struct timespec deadline;
+	long long last_done = 0;
+	double last_time = progress->start;
+
+	pthread_mutex_lock(&progress->lock);
+	while (!progress->stop) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += progress->interval_ms / 1000;
+		deadline.tv_nsec += (progress->interval_ms % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+
+		pthread_cond_timedwait(&progress->wake, &progress->lock, &deadline);
+		if (!progress->stop) {
+			emit(progress, "running", &last_done, &last_time);
+		}
+	}
+	pthread_mutex_unlock(&progress->lock);
+
+	return NULL;
+}
+
+int progress_start(struct conv_progress *progress) {
+	if (progress->fd < 0) {
+		return 0;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	progress->start = monotonic();
+	pthread_mutex_init(&progress->lock, NULL);
+	pthread_cond_init(&progress->wake, NULL);
+	if (pthread_create(&progress->thread, NULL, reporter, progress)) {
+		return 1;
+	}
+	progress->running = 1;
+
+	return 0;
+}
+
+void progress_finish(struct conv_progress *progress, const char *status) {
+	long long last_done = 0;
+	double last_time = progress->start;
+
+	if (!progress->running) {
+		return;
+	}
+
+	pthread_mutex_lock(&progress->lock);
+	progress->stop = 1;
+	pthread_cond_signal(&progress->wake);
+	pthread_mutex_unlock(&progress->lock);
+	pthread_join(progress->thread, NULL);
+	progress->running = 0;
+
+	emit(progress, status, &last_done, &last_time);
+	if (progress->owned) {
+		close(progress->fd);
+	}
+	progress->fd = -1;
+}
@@ -0,0 +1,94 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Machine readable progress reports.  Converting threads add to shared
+ * counters every few thousand rows; a reporter thread samples them at a
+ * fixed interval and writes one JSON object per line to a file descriptor
+ * or Unix socket.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#ifndef progress_INCLUDED
+#define progress_INCLUDED
+
+#include <pthread.h>
+
+/* Rows between updates of the shared counters */
+#define PROGRESS_ROWS 4096
+
+struct conv_progress {
+	int fd; /* -1 when progress reporting is off */
+	int owned; /* fd was opened by progress_open_socket and is closed */
+	int interval_ms;
+	int passes; /* passes over the csv data, 2 with autophysicalmaximum */
+	long long total_bytes; /* csv data size, headersize excluded */
+	long long total_rows; /* known from a row index, -1 otherwise */
+	long long total_datarecords; /* expected from total_rows */
+
+	/* counters published by the converting thread */
+	const char *phase;
+	int pass;
+	long long bytes;
+	long long rows;
+	int datarecords;
+
+	int running;
+	int stop;
+	double start;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+};
+
+void progress_init(struct conv_progress *progress);
+int progress_open_socket(struct conv_progress *progress, const char *path);
+int progress_start(struct conv_progress *progress);
+void progress_finish(struct conv_progress *progress, const char *status);
+
+static inline void progress_phase(struct conv_progress *progress,
+		const char *phase, int pass) {
+	__atomic_store_n(&progress->bytes, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&progress->rows, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&progress->datarecords, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&progress->pass, pass, __ATOMIC_RELAXED);
+	__atomic_store_n(&progress->phase, phase, __ATOMIC_RELEASE);
+}
+
+/*
+ * Adds to the counters of the current pass.  Converting threads call this
+ * every PROGRESS_ROWS rows rather than per row.
+ */
+static inline void progress_add(struct conv_progress *progress,
+		long long rows, long long bytes, int datarecords) {
+	__atomic_fetch_add(&progress->rows, rows, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&progress->bytes, bytes, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&progress->datarecords, datarecords, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Quantile sketches.  The bucket of a value is read from the bits of the
+ * double: the exponent and the top QUANTILE_SUB_BITS bits of the mantissa,
+ * so adding a value takes a shift, a mask and an increment.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#include "quantile.h"
+#include <math.h>
+#include <string.h>
+
+void quantile_init(struct quantile_sketch *s) {
+	memset(s, 0, sizeof(struct quantile_sketch));
+}
+
+static inline int bucket_of(double v) {
+	unsigned long long bits;
+	int e;
+
+	memcpy(&bits, &v, sizeof(bits));
+	e = (int) ((bits >> 52) & 0x7ff) - 1023;
+	if (e < QUANTILE_MIN_EXP) {
+		return 0;
+	}
+	if (e >= QUANTILE_MAX_EXP) {
+		return QUANTILE_BUCKETS - 1;
+	}
+
+	return ((e - QUANTILE_MIN_EXP) << QUANTILE_SUB_BITS)
+			| (int) ((bits >> (52 - QUANTILE_SUB_BITS))
+					& ((1 << QUANTILE_SUB_BITS) - 1));
+}
+
+/* Upper end of a bucket */
+static double bucket_limit(int b) {
+	return ldexp(1.0 + ((b & ((1 << QUANTILE_SUB_BITS) - 1)) + 1)
+			* QUANTILE_ERROR, QUANTILE_MIN_EXP + (b >> QUANTILE_SUB_BITS));
+}
+
+/* Adds the absolute value of every signal of a row, one sketch per signal */
+void quantile_update(struct quantile_sketch *s, const double *value, int n) {
+	int j;
+	double v;
+
+	for (j = 0; j < n; j++) {
+		v = fabs(value[j]);
+		if (v != v) {
+			continue;
+		}
+		s[j].bucket[bucket_of(v)]++;
+		s[j].count++;
+		if (v > s[j].max) {
+			s[j].max = v;
+		}
+	}
+}
+
+/*
+ * Returns a value that at least a fraction q of the absolute values do not
+ * exceed: the upper end of the bucket of the q quantile, but never more than
+ * the maximum.  q = 1 gives the maximum.
+ */
+double quantile_get(const struct quantile_sketch *s, double q) {
+	int b;
+	long long above, allowed = (long long) ((1.0 - q) * s->count);
+
+	if (allowed <= 0) {
+		return s->max;
+	}
+
+	for (b = QUANTILE_BUCKETS - 1, above = 0; b > 0; b--) {
+		above += s->bucket[b];
+		if (above > allowed) {
+			break;
+		}
+	}
+
+	return b < QUANTILE_BUCKETS - 1 && bucket_limit(b) < s->max
+			? bucket_limit(b) : s->max;
+}
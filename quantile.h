@@ -0,0 +1,60 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Quantiles of the absolute values of every signal, kept in a histogram
+ * of fixed size with buckets of a constant relative width.  A quantile is
+ * found to within QUANTILE_ERROR of its value, however many values were
+ * added, and two sketches of parts of a file merge by adding their counts.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#ifndef quantile_INCLUDED
+#define quantile_INCLUDED
+
+/* Mantissa bits per bucket, for a relative bucket width of 2^-7 */
+#define QUANTILE_SUB_BITS 7
+#define QUANTILE_ERROR (1.0 / (1 << QUANTILE_SUB_BITS))
+
+/* Values below 2^MIN_EXP share the first bucket, from 2^MAX_EXP the last */
+#define QUANTILE_MIN_EXP -20
+#define QUANTILE_MAX_EXP 24
+#define QUANTILE_BUCKETS \
+	((QUANTILE_MAX_EXP - QUANTILE_MIN_EXP) << QUANTILE_SUB_BITS)
+
+struct quantile_sketch {
+	long long count; /* NaN not included */
+	double max;
+	long long bucket[QUANTILE_BUCKETS];
+};
+
+void quantile_init(struct quantile_sketch *s);
+void quantile_update(struct quantile_sketch *s, const double *value, int n);
+double quantile_get(const struct quantile_sketch *s, double q);
+
+#endif
@@ -0,0 +1,325 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Row index.  Building it is a single pass counting newlines: the bytes are
+ * compared with '\n' 16 at a time and the matches summed per 1 KiB chunk.
+ * Only the chunk holding the newline of an indexed row is turned into bit
+ * masks and looked at newline by newline.
+ *
+ * The sidecar file is in the byte order of the machine that wrote it.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#include "rowindex.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define ROWINDEX_MAGIC "A2EIDX01"
+#define ROWINDEX_BLOCK (1 << 20)
+#define ROWINDEX_CHUNK 1024
+
+#if defined(__SSE2__)
+/* Newlines in ROWINDEX_CHUNK bytes, at most 64 per byte lane */
+static inline int count_chunk(const char *p) {
+	const __m128i nl = _mm_set1_epi8('\n');
+	__m128i acc = _mm_setzero_si128();
+	int i;
+
+	for (i = 0; i < ROWINDEX_CHUNK; i += 16) {
+		acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(
+				_mm_loadu_si128((const __m128i *) (p + i)), nl));
+	}
+	acc = _mm_sad_epu8(acc, _mm_setzero_si128());
+
+	return _mm_cvtsi128_si32(acc) + _mm_extract_epi16(acc, 4);
+}
+
+/* Bit i is set if p[i] is a newline */
+static inline unsigned long long newline_mask(const char *p) {
+	const __m128i nl = _mm_set1_epi8('\n');
+	unsigned long long mask = 0;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		mask |= (unsigned long long) _mm_movemask_epi8(_mm_cmpeq_epi8(
+				_mm_loadu_si128((const __m128i *) (p + 16 * i)), nl)) << (16 * i);
+	}
+	return mask;
+}
+#endif
+
+/*
+ * Counts the newlines in block[0, n) into *rows, but stops after the one
+ * that makes *rows reach target.  Returns the position after the last
+ * newline counted in that case, n otherwise.
+ */
+static size_t count_newlines(const char *block, size_t n, long long *rows,
+		long long target) {
+	size_t i = 0;
+	long long r = *rows;
+#if defined(__SSE2__)
+	unsigned long long mask;
+	int c;
+
+	/* whole chunks are only counted */
+	for (; i + ROWINDEX_CHUNK <= n; i += ROWINDEX_CHUNK) {
+		c = count_chunk(block + i);
+		if (r + c >= target) {
+			break;
+		}
+		r += c;
+	}
+
+	/* the newlines of the chunk with the target one are looked at in turn */
+	for (; i + 64 <= n; i += 64) {
+		for (mask = newline_mask(block + i); mask; mask &= mask - 1) {
+			if (++r == target) {
+				*rows = r;
+				return i + __builtin_ctzll(mask) + 1;
+			}
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		if (block[i] == '\n' && ++r == target) {
+			*rows = r;
+			return i + 1;
+		}
+	}
+
+	*rows = r;
+	return n;
+}
+
+static void input_identity(const char *path, long long *size,
+		long long *mtime) {
+	struct stat st;
+
+	*size = *mtime = -1;
+	if (!stat(path, &st)) {
+		*size = st.st_size;
+		*mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+	}
+}
+
+/*
+ * Indexes the rows of inputfile, which is the file at path.  Returns 0 on
+ * success.
+ */
+int rowindex_build(FILE *inputfile, const char *path, int headersize,
+		struct row_index *index) {
+	char *block;
+	size_t n, pos;
+	long long offset = 0, capacity = 1024, *grown;
+
+	memset(index, 0, sizeof(struct row_index));
+	input_identity(path, &index->input_size, &index->input_mtime);
+	index->headersize = headersize;
+	index->step = ROWINDEX_STEP;
+
+	block = (char *) malloc(ROWINDEX_BLOCK);
+	index->offsets = (long long *) malloc(sizeof(long long) * capacity);
+	if (block == NULL || index->offsets == NULL) {
+		free(block);
+		rowindex_free(index);
+		printf("Critical error: Malloc error (row index)");
+		return 1;
+	}
+	index->offsets[index->count++] = 0;
+
+	fseek(inputfile, (long long) headersize, SEEK_SET);
+	while ((n = fread(block, 1, ROWINDEX_BLOCK, inputfile)) > 0) {
+		for (pos = 0; pos < n;) {
+			pos += count_newlines(block + pos, n - pos, &index->rows,
+					index->count * index->step);
+			if (index->rows < index->count * index->step) {
+				break;
+			}
+
+			if (index->count == capacity) {
+				capacity *= 2;
+				grown = (long long *) realloc(index->offsets,
+						sizeof(long long) * capacity);
+				if (grown == NULL) {
+					free(block);
+					rowindex_free(index);
+					printf("Critical error: Malloc error (row index)");
+					return 1;
+				}
+				index->offsets = grown;
+			}
+			index->offsets[index->count++] = offset + pos;
+		}
+		offset += n;
+	}
+	free(block);
+
+	/* a row at the very end would have no data */
+	if (index->count > 1 && index->offsets[index->count - 1] == offset) {
+		index->count--;
+	}
+
+	return 0;
+}
+
+/* The index of rows of length bytes in datasize bytes after headersize */
+void rowindex_fixed(long long datasize, int headersize, int length,
+		struct row_index *index) {
+	memset(index, 0, sizeof(struct row_index));
+	index->headersize = headersize;
+	index->step = 1;
+	index->length = length;
+	index->rows = datasize / length;
+}
+
+/*
+ * Loads the index at path if it is for the file at inputpath as it is now.
+ * Returns 0 if it was loaded.
+ */
+int rowindex_load(const char *path, const char *inputpath, int headersize,
+		struct row_index *index) {
+	char magic[8];
+	long long size, mtime;
+	FILE *f;
+	int error;
+
+	memset(index, 0, sizeof(struct row_index));
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		return 1;
+	}
+
+	input_identity(inputpath, &size, &mtime);
+	error = fread(magic, 8, 1, f) != 1 || memcmp(magic, ROWINDEX_MAGIC, 8)
+			|| fread(&index->input_size, sizeof(long long), 1, f) != 1
+			|| fread(&index->input_mtime, sizeof(long long), 1, f) != 1
+			|| fread(&index->headersize, sizeof(int), 1, f) != 1
+			|| fread(&index->step, sizeof(int), 1, f) != 1
+			|| fread(&index->rows, sizeof(long long), 1, f) != 1
+			|| fread(&index->count, sizeof(long long), 1, f) != 1
+			|| index->input_size != size || index->input_mtime != mtime
+			|| index->headersize != headersize || index->step < 1
+			|| index->count < 1 || index->count > index->rows / index->step + 1;
+
+	if (!error) {
+		index->offsets = (long long *) malloc(sizeof(long long) * index->count);
+		error = index->offsets == NULL || fread(index->offsets,
+				sizeof(long long), index->count, f) != (size_t) index->count;
+	}
+	fclose(f);
+
+	if (error) {
+		rowindex_free(index);
+	}
+	return error;
+}
+
+/*
+ * Writes the index to path, replacing an older one atomically.  Returns 0
+ * on success.
+ */
+int rowindex_save(const char *path, const struct row_index *index) {
+	char tmp[4096];
+	FILE *f;
+	int error;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	f = fopen(tmp, "wb");
+	if (f == NULL) {
+		return 1;
+	}
+
+	fwrite(ROWINDEX_MAGIC, 8, 1, f);
+	fwrite(&index->input_size, sizeof(long long), 1, f);
+	fwrite(&index->input_mtime, sizeof(long long), 1, f);
+	fwrite(&index->headersize, sizeof(int), 1, f);
+	fwrite(&index->step, sizeof(int), 1, f);
+	fwrite(&index->rows, sizeof(long long), 1, f);
+	fwrite(&index->count, sizeof(long long), 1, f);
+	fwrite(index->offsets, sizeof(long long), index->count, f);
+
+	error = fflush(f) || ferror(f);
+	error |= fclose(f) != 0;
+	if (error || rename(tmp, path)) {
+		unlink(tmp);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Returns the offset of a row, headersize excluded, reading from the
+ * nearest indexed row before it.  Returns -1 for a row past the end.
+ */
+long long rowindex_seek(FILE *inputfile, const struct row_index *index,
+		long long row) {
+	char block[65536];
+	size_t n, pos;
+	long long i, r, offset;
+
+	if (row < 0 || row > index->rows) {
+		return -1;
+	}
+	if (index->length > 0) {
+		return row * index->length;
+	}
+
+	i = row / index->step;
+	if (i >= index->count) {
+		i = index->count - 1;
+	}
+	r = i * index->step;
+	offset = index->offsets[i];
+	if (r == row) {
+		return offset;
+	}
+
+	fseek(inputfile, (long long) index->headersize + offset, SEEK_SET);
+	while ((n = fread(block, 1, sizeof(block), inputfile)) > 0) {
+		pos = count_newlines(block, n, &r, row);
+		if (r == row) {
+			return offset + pos;
+		}
+		offset += n;
+	}
+
+	return -1;
+}
+
+void rowindex_free(struct row_index *index) {
+	free(index->offsets);
+	index->offsets = NULL;
+	index->count = 0;
+}
@@ -0,0 +1,67 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Row index of a csv file: the byte offset of every ROWINDEX_STEP-th row,
+ * so that any row can be found by reading at most ROWINDEX_STEP rows.  It
+ * can be kept in a sidecar file and reused while the csv file is unchanged.
+ * Rows which all have one length, as binary ones, need no offsets at all.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#ifndef rowindex_INCLUDED
+#define rowindex_INCLUDED
+
+#include <stdio.h>
+
+/* Rows between index entries */
+#define ROWINDEX_STEP 1024
+
+struct row_index {
+	long long input_size; /* identify the csv file the index is for */
+	long long input_mtime;
+	int headersize;
+	int step;
+	long long rows; /* rows ending in a newline */
+	long long count;
+	long long *offsets; /* of row i * step, headersize excluded */
+	int length; /* of every row, 0 if they differ */
+};
+
+int rowindex_build(FILE *inputfile, const char *path, int headersize,
+		struct row_index *index);
+void rowindex_fixed(long long datasize, int headersize, int length,
+		struct row_index *index);
+int rowindex_load(const char *path, const char *inputpath, int headersize,
+		struct row_index *index);
+int rowindex_save(const char *path, const struct row_index *index);
+long long rowindex_seek(FILE *inputfile, const struct row_index *index,
+		long long row);
+void rowindex_free(struct row_index *index);
+
+#endif
@@ -0,0 +1,471 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Conversion statistics for the --stats option.  Timing is only taken when
+ * statistics were requested, so a normal run pays two flag tests per phase.
+ *
+ * Signal statistics are reduced two signals at a time with SSE2, NaN lanes
+ * masked out of the sums and left out of the minima and maxima.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#include "stats.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static const char *phase_names[PHASES] = { "template", "check", "index",
+		"physmax", "header", "convert" };
+
+/***************** allocation counting **********************************/
+
+static long long allocations, allocated_bytes;
+static int counting; /* set once a job asks for --stats */
+
+#ifdef __GLIBC__
+/*
+ * glibc lets a program replace the allocator entry points and still reach
+ * the real ones, which is how allocations made by stdio and the xml parser
+ * are counted as well.
+ */
+extern "C" {
+void *__libc_malloc(size_t);
+void *__libc_calloc(size_t, size_t);
+void *__libc_realloc(void *, size_t);
+void *__libc_memalign(size_t, size_t);
+void *__libc_valloc(size_t);
+
+static inline void count(size_t size) {
+	if (__atomic_load_n(&counting, __ATOMIC_RELAXED)) {
+		__atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&allocated_bytes, (long long) size,
+				__ATOMIC_RELAXED);
+	}
+}
+
+void *malloc(size_t size) {
+	count(size);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+	count(n * size);
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+	count(size);
+	return __libc_realloc(ptr, size);
+}
+
+/* the aligned buffers of io_uring and O_DIRECT */
+void *memalign(size_t alignment, size_t size) {
+	count(size);
+	return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+	count(size);
+	return __libc_memalign(alignment, size);
+}
+
+void *valloc(size_t size) {
+	count(size);
+	return __libc_valloc(size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+	void *p;
+
+	if (alignment == 0 || alignment % sizeof(void *)
+			|| (alignment & (alignment - 1))) {
+		return EINVAL;
+	}
+	count(size);
+	p = __libc_memalign(alignment, size);
+	if (p == NULL && size > 0) {
+		return ENOMEM;
+	}
+	*ptr = p;
+	return 0;
+}
+}
+#endif
+
+long long stats_allocations(void) {
+	return __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+}
+
+long long stats_allocated_bytes(void) {
+	return __atomic_load_n(&allocated_bytes, __ATOMIC_RELAXED);
+}
+
+/* Peak resident set size in kilobytes */
+long stats_peak_rss(void) {
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage)) {
+		return 0;
+	}
+#if defined(__APPLE__) || defined(__MACH__)
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+}
+
+/***************** timing ***********************************************/
+
+static double clock_seconds(clockid_t id) {
+	struct timespec ts;
+
+	clock_gettime(id, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void stats_init(struct conv_stats *stats, int mode) {
+	memset(stats, 0, sizeof(*stats));
+	stats->mode = mode;
+}
+
+void stats_begin(struct conv_stats *stats) {
+	if (!stats->mode) {
+		return;
+	}
+	/* allocations are only counted for jobs that report them */
+	if (!stats->counting) {
+		__atomic_store_n(&counting, 1, __ATOMIC_RELAXED);
+		stats->counting = 1;
+		stats->allocations_start = stats_allocations();
+		stats->allocated_bytes_start = stats_allocated_bytes();
+	}
+	/* the job's own thread, not the other jobs of a daemon */
+	stats->cpu_process = 0;
+	stats->wall_start = clock_seconds(CLOCK_MONOTONIC);
+	stats->cpu_start = clock_seconds(CLOCK_THREAD_CPUTIME_ID);
+}
+
+/* Begins a phase run by threads of the job, timed with the process clock */
+void stats_begin_threads(struct conv_stats *stats) {
+	stats_begin(stats);
+	if (!stats->mode) {
+		return;
+	}
+	stats->cpu_process = 1;
+	stats->cpu_start = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void stats_end(struct conv_stats *stats, int phase) {
+	if (!stats->mode) {
+		return;
+	}
+	stats->wall[phase] += clock_seconds(CLOCK_MONOTONIC) - stats->wall_start;
+	stats->cpu[phase] += clock_seconds(stats->cpu_process ?
+			CLOCK_PROCESS_CPUTIME_ID : CLOCK_THREAD_CPUTIME_ID)
+			- stats->cpu_start;
+}
+
+/***************** output ***********************************************/
+
+static void json_string(FILE *f, const char *str) {
+	fputc('"', f);
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\') {
+			fprintf(f, "\\%c", *str);
+		} else if ((unsigned char) *str < 32) {
+			fprintf(f, "\\u%04x", (unsigned char) *str);
+		} else {
+			fputc(*str, f);
+		}
+	}
+	fputc('"', f);
+}
+
+static double rate(double amount, double seconds) {
+	return seconds > 0.0 ? amount / seconds : 0.0;
+}
+
+void stats_print(FILE *f, const struct conv_stats *stats,
+		const struct conv_template *tpl) {
+	int i;
+	double wall = 0.0, cpu = 0.0, convert = stats->wall[PHASE_CONVERT];
+
+	for (i = 0; i < PHASES; i++) {
+		wall += stats->wall[i];
+		cpu += stats->cpu[i];
+	}
+
+	if (stats->mode == STATS_JSON) {
+		fprintf(f, "{\"phases\":{");
+		for (i = 0; i < PHASES; i++) {
+			fprintf(f, "%s\"%s\":{\"wall\":%.6f,\"cpu\":%.6f}", i ? "," : "",
+					phase_names[i], stats->wall[i], stats->cpu[i]);
+		}
+		fprintf(f, "},\"wall\":%.6f,\"cpu\":%.6f", wall, cpu);
+		fprintf(f, ",\"bytes_read\":%lld,\"bytes_written\":%lld",
+				stats->bytes_read, stats->bytes_written);
+		fprintf(f, ",\"rows\":%lld,\"datarecords\":%d", stats->rows,
+				stats->datarecords);
+		fprintf(f, ",\"physmax\":");
+		json_string(f, stats->physmax_method ? stats->physmax_method : "");
+		fprintf(f, ",\"rows_per_s\":%.1f,\"mb_per_s\":%.3f",
+				rate(stats->rows, convert),
+				rate(stats->bytes_read, wall) / 1e6);
+		fprintf(f, ",\"clips\":{");
+		for (i = 0; i < tpl->edfsignals; i++) {
+			if (i) {
+				fputc(',', f);
+			}
+			json_string(f, tpl->signames[tpl->sigcolumn[i]]);
+			fprintf(f, ":%lld", stats->clips[i]);
+		}
+		fputc('}', f);
+		if (stats->memory_budget > 0) {
+			fprintf(f, ",\"memory_budget\":%lld,\"memory_planned\":%lld",
+					stats->memory_budget, stats->memory_planned);
+		}
+		fprintf(f, ",\"peak_rss_kb\":%ld,\"allocations\":%lld"
+				",\"allocated_bytes\":%lld}\n", stats_peak_rss(),
+				stats_allocations() - stats->allocations_start,
+				stats_allocated_bytes() - stats->allocated_bytes_start);
+		return;
+	}
+
+	fprintf(f, "%-12s %12s %12s\n", "phase", "wall (s)", "cpu (s)");
+	for (i = 0; i < PHASES; i++) {
+		fprintf(f, "%-12s %12.6f %12.6f\n", phase_names[i], stats->wall[i],
+				stats->cpu[i]);
+	}
+	fprintf(f, "%-12s %12.6f %12.6f\n", "total", wall, cpu);
+	fprintf(f, "bytes read:    %lld\n", stats->bytes_read);
+	fprintf(f, "bytes written: %lld\n", stats->bytes_written);
+	fprintf(f, "rows:          %lld (%.0f rows/s)\n", stats->rows,
+			rate(stats->rows, convert));
+	fprintf(f, "throughput:    %.3f MB/s\n",
+			rate(stats->bytes_read, wall) / 1e6);
+	fprintf(f, "datarecords:   %d\n", stats->datarecords);
+	if (stats->physmax_method) {
+		fprintf(f, "physmax:       %s\n", stats->physmax_method);
+	}
+	fprintf(f, "clipped samples per signal:\n");
+	for (i = 0; i < tpl->edfsignals; i++) {
+		fprintf(f, "  %-16s %lld\n", tpl->signames[tpl->sigcolumn[i]],
+				stats->clips[i]);
+	}
+	if (stats->memory_budget > 0) {
+		fprintf(f, "memory budget: %lld bytes, %lld planned for buffers\n",
+				stats->memory_budget, stats->memory_planned);
+	}
+	fprintf(f, "peak rss:      %ld kB\n", stats_peak_rss());
+	fprintf(f, "allocations:   %lld (%lld bytes)\n",
+			stats_allocations() - stats->allocations_start,
+			stats_allocated_bytes() - stats->allocated_bytes_start);
+}
+
+/***************** signal statistics ************************************/
+
+static void sigstats_reset_block(struct signal_stats *s) {
+	int j;
+
+	s->block_samples = 0;
+	for (j = 0; j < s->nsignals; j++) {
+		s->block_min[j] = HUGE_VAL;
+		s->block_max[j] = -HUGE_VAL;
+		s->block_sum[j] = 0.0;
+		s->block_sumsq[j] = 0.0;
+		s->block_nan[j] = 0.0;
+	}
+}
+
+void sigstats_init(struct signal_stats *s, int nsignals) {
+	int j;
+
+	memset(s, 0, sizeof(*s));
+	s->nsignals = nsignals;
+	for (j = 0; j < nsignals; j++) {
+		s->min[j] = HUGE_VAL;
+		s->max[j] = -HUGE_VAL;
+	}
+	sigstats_reset_block(s);
+}
+
+/* Adds one sample of every signal to the current datarecord */
+void sigstats_add(struct signal_stats *s, const double *value) {
+	int j = 0;
+	double v;
+#if defined(__SSE2__)
+	const __m128d one = _mm_set1_pd(1.0);
+	__m128d x, valid;
+
+	for (; j + 2 <= s->nsignals; j += 2) {
+		x = _mm_loadu_pd(value + j);
+		valid = _mm_cmpord_pd(x, x);
+
+		/* minpd and maxpd return the second operand if the first is NaN */
+		_mm_storeu_pd(s->block_min + j,
+				_mm_min_pd(x, _mm_loadu_pd(s->block_min + j)));
+		_mm_storeu_pd(s->block_max + j,
+				_mm_max_pd(x, _mm_loadu_pd(s->block_max + j)));
+
+		x = _mm_and_pd(x, valid);
+		_mm_storeu_pd(s->block_sum + j,
+				_mm_add_pd(_mm_loadu_pd(s->block_sum + j), x));
+		_mm_storeu_pd(s->block_sumsq + j,
+				_mm_add_pd(_mm_loadu_pd(s->block_sumsq + j), _mm_mul_pd(x, x)));
+		_mm_storeu_pd(s->block_nan + j,
+				_mm_add_pd(_mm_loadu_pd(s->block_nan + j),
+						_mm_andnot_pd(valid, one)));
+	}
+#endif
+	for (; j < s->nsignals; j++) {
+		v = value[j];
+		if (v != v) {
+			s->block_nan[j] += 1.0;
+			continue;
+		}
+		if (v < s->block_min[j]) {
+			s->block_min[j] = v;
+		}
+		if (v > s->block_max[j]) {
+			s->block_max[j] = v;
+		}
+		s->block_sum[j] += v;
+		s->block_sumsq[j] += v * v;
+	}
+
+	s->block_samples++;
+}
+
+/* Folds the current datarecord, which has been written, into the totals */
+void sigstats_flush(struct signal_stats *s) {
+	int j;
+
+	for (j = 0; j < s->nsignals; j++) {
+		if (s->block_min[j] < s->min[j]) {
+			s->min[j] = s->block_min[j];
+		}
+		if (s->block_max[j] > s->max[j]) {
+			s->max[j] = s->block_max[j];
+		}
+		s->sum[j] += s->block_sum[j];
+		s->sumsq[j] += s->block_sumsq[j];
+		s->nan[j] += (long long) s->block_nan[j];
+	}
+	s->samples += s->block_samples;
+
+	sigstats_reset_block(s);
+}
+
+/* Adds the totals of from to those of into */
+void sigstats_merge(struct signal_stats *into, const struct signal_stats *from) {
+	int j;
+
+	for (j = 0; j < into->nsignals; j++) {
+		if (from->min[j] < into->min[j]) {
+			into->min[j] = from->min[j];
+		}
+		if (from->max[j] > into->max[j]) {
+			into->max[j] = from->max[j];
+		}
+		into->sum[j] += from->sum[j];
+		into->sumsq[j] += from->sumsq[j];
+		into->nan[j] += from->nan[j];
+		into->saturated[j] += from->saturated[j];
+	}
+	into->samples += from->samples;
+}
+
+/* JSON has no NaN or infinity, those are written as null */
+static void json_number(FILE *f, double x) {
+	if (isfinite(x)) {
+		fprintf(f, "%.15g", x);
+	} else {
+		fputs("null", f);
+	}
+}
+
+/*
+ * Writes the statistics of the output file output to path as JSON, scaled
+ * by the multipliers of the template.  Returns 0 on success.
+ */
+int sigstats_write(const char *path, const char *output,
+		const struct signal_stats *s, const struct conv_template *tpl) {
+	int j, column, error;
+	long long counted;
+	double m, lo, hi;
+	FILE *f;
+
+	f = fopen(path, "w");
+	if (f == NULL) {
+		printf("Can not open file %s for writing.", path);
+		return 1;
+	}
+
+	fprintf(f, "{\"file\":");
+	json_string(f, output);
+	fprintf(f, ",\"samples\":%lld,\"signals\":[", s->samples);
+	for (j = 0; j < s->nsignals; j++) {
+		column = tpl->sigcolumn[j];
+		m = tpl->multiplier[column];
+		counted = s->samples - s->nan[j];
+		lo = counted ? (m < 0.0 ? s->max[j] : s->min[j]) * m : NAN;
+		hi = counted ? (m < 0.0 ? s->min[j] : s->max[j]) * m : NAN;
+
+		fprintf(f, "%s{\"label\":", j ? "," : "");
+		json_string(f, tpl->signames[column]);
+		fprintf(f, ",\"dimension\":");
+		json_string(f, tpl->sigdimensions[column]);
+		fprintf(f, ",\"min\":");
+		json_number(f, lo);
+		fprintf(f, ",\"max\":");
+		json_number(f, hi);
+		fprintf(f, ",\"mean\":");
+		json_number(f, counted ? s->sum[j] / counted * m : NAN);
+		fprintf(f, ",\"rms\":");
+		json_number(f, counted ? sqrt(s->sumsq[j] / counted) * fabs(m) : NAN);
+		fprintf(f, ",\"nan\":%lld,\"saturated\":%lld}", s->nan[j],
+				s->saturated[j]);
+	}
+	fprintf(f, "]}\n");
+
+	error = fflush(f) || ferror(f);
+	error |= fclose(f) != 0;
+	if (error) {
+		printf("Error: Can not write %s", path);
+		return 1;
+	}
+
+	return 0;
+}
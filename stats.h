@@ -0,0 +1,117 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Conversion statistics for the --stats option: per phase wall and cpu
+ * time, i/o volume, throughput, clip counts and memory use.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#ifndef stats_INCLUDED
+#define stats_INCLUDED
+
+#include "convert.h"
+#include <stdio.h>
+
+#define STATS_OFF 0
+#define STATS_TEXT 1
+#define STATS_JSON 2
+
+enum conv_phase {
+	PHASE_TEMPLATE,
+	PHASE_CHECK,
+	PHASE_INDEX,
+	PHASE_PHYSMAX,
+	PHASE_HEADER,
+	PHASE_CONVERT,
+	PHASES
+};
+
+struct conv_stats {
+	int mode; /* STATS_OFF, STATS_TEXT or STATS_JSON */
+	double wall[PHASES];
+	double cpu[PHASES];
+	double wall_start, cpu_start;
+	int cpu_process; /* cpu_start is of the process rather than the thread */
+	long long bytes_read;
+	long long bytes_written;
+	long long rows;
+	int datarecords;
+	const char *physmax_method; /* how the physical maxima were obtained */
+	long long memory_budget; /* --max-memory, 0 for none */
+	long long memory_planned; /* bytes of buffers sized against it */
+	long long clips[MAX_EDF_SIGNALS];
+	/* the process-wide allocation counts when the job started */
+	int counting;
+	long long allocations_start, allocated_bytes_start;
+};
+
+void stats_init(struct conv_stats *stats, int mode);
+void stats_begin(struct conv_stats *stats);
+void stats_begin_threads(struct conv_stats *stats);
+void stats_end(struct conv_stats *stats, int phase);
+void stats_print(FILE *f, const struct conv_stats *stats,
+		const struct conv_template *tpl);
+
+/*
+ * Statistics of the samples of every signal of one output file, in the units
+ * of the csv file.  Samples are added to the partials of the datarecord being
+ * filled, which are folded into the totals when it is written, so exactly
+ * the samples in the file are counted.
+ */
+struct signal_stats {
+	int nsignals;
+	long long samples; /* per signal */
+	double min[MAX_EDF_SIGNALS];
+	double max[MAX_EDF_SIGNALS];
+	double sum[MAX_EDF_SIGNALS];
+	double sumsq[MAX_EDF_SIGNALS];
+	long long nan[MAX_EDF_SIGNALS];
+	long long saturated[MAX_EDF_SIGNALS];
+
+	/* of the current datarecord */
+	long long block_samples;
+	double block_min[MAX_EDF_SIGNALS];
+	double block_max[MAX_EDF_SIGNALS];
+	double block_sum[MAX_EDF_SIGNALS];
+	double block_sumsq[MAX_EDF_SIGNALS];
+	double block_nan[MAX_EDF_SIGNALS];
+};
+
+void sigstats_init(struct signal_stats *s, int nsignals);
+void sigstats_add(struct signal_stats *s, const double *value);
+void sigstats_flush(struct signal_stats *s);
+void sigstats_merge(struct signal_stats *into, const struct signal_stats *from);
+int sigstats_write(const char *path, const char *output,
+		const struct signal_stats *s, const struct conv_template *tpl);
+
+long long stats_allocations(void);
+long long stats_allocated_bytes(void);
+long stats_peak_rss(void);
+
+#endif
@@ -0,0 +1,585 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * io_uring backend behind --io=uring.  A file gets its own ring and
+ * URING_DEPTH registered buffers of URING_BLOCK bytes.  Reading keeps every
+ * buffer busy with a read ahead of the consumer; writing fills one buffer
+ * while the others are written behind.  The rings are driven with the raw
+ * system calls, so no liburing is needed.  The file is handed out as a
+ * stdio stream made with fopencookie().
+ *
+ * With --io=uring,direct the output is opened with O_DIRECT.  Full buffers
+ * are aligned in offset and size, the few writes that are not (the last
+ * part of the file and the datarecord count in the header) go through a
+ * second, buffered descriptor.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#include "uring.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_URING
+#endif
+#endif
+
+#ifdef HAVE_URING
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+/* O_DIRECT alignment of offsets and sizes */
+#define DIRECT_ALIGN 4096
+
+#define SLOT_IDLE 0
+#define SLOT_BUSY 1
+#define SLOT_DONE 2
+
+/***************** ring *************************************************/
+
+struct ring {
+	int fd;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	char *sq_map, *cq_map;
+	size_t sq_size, cq_size, sqes_size;
+};
+
+static void ring_exit(struct ring *r) {
+	if (r->sqes != NULL) {
+		munmap(r->sqes, r->sqes_size);
+	}
+	if (r->cq_map != NULL && r->cq_map != r->sq_map) {
+		munmap(r->cq_map, r->cq_size);
+	}
+	if (r->sq_map != NULL) {
+		munmap(r->sq_map, r->sq_size);
+	}
+	if (r->fd >= 0) {
+		close(r->fd);
+	}
+}
+
+static int ring_init(struct ring *r, unsigned entries) {
+	struct io_uring_params p;
+	void *map;
+
+	memset(r, 0, sizeof(*r));
+	memset(&p, 0, sizeof(p));
+
+	r->fd = (int) syscall(__NR_io_uring_setup, entries, &p);
+	if (r->fd < 0) {
+		return 1;
+	}
+
+	r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cq_size > r->sq_size) {
+			r->sq_size = r->cq_size;
+		}
+		r->cq_size = r->sq_size;
+	}
+
+	map = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (map == MAP_FAILED) {
+		ring_exit(r);
+		return 1;
+	}
+	r->sq_map = (char *) map;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		r->cq_map = r->sq_map;
+	} else {
+		map = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (map == MAP_FAILED) {
+			ring_exit(r);
+			return 1;
+		}
+		r->cq_map = (char *) map;
+	}
+
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	map = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (map == MAP_FAILED) {
+		ring_exit(r);
+		return 1;
+	}
+	r->sqes = (struct io_uring_sqe *) map;
+
+	r->sq_tail = (unsigned *) (r->sq_map + p.sq_off.tail);
+	r->sq_mask = (unsigned *) (r->sq_map + p.sq_off.ring_mask);
+	r->sq_array = (unsigned *) (r->sq_map + p.sq_off.array);
+	r->cq_head = (unsigned *) (r->cq_map + p.cq_off.head);
+	r->cq_tail = (unsigned *) (r->cq_map + p.cq_off.tail);
+	r->cq_mask = (unsigned *) (r->cq_map + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *) (r->cq_map + p.cq_off.cqes);
+
+	return 0;
+}
+
+/* Returns a cleared submission queue entry to fill in for ring_submit() */
+static struct io_uring_sqe *ring_sqe(struct ring *r) {
+	unsigned index = *r->sq_tail & *r->sq_mask;
+	struct io_uring_sqe *sqe = &r->sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	r->sq_array[index] = index;
+	return sqe;
+}
+
+static int ring_submit(struct ring *r) {
+	long n;
+
+	__atomic_store_n(r->sq_tail, *r->sq_tail + 1, __ATOMIC_RELEASE);
+	do {
+		n = syscall(__NR_io_uring_enter, r->fd, 1, 0, 0, NULL, 0);
+	} while (n < 0 && errno == EINTR);
+
+	return n != 1;
+}
+
+/* Waits for the next completion */
+static int ring_wait(struct ring *r, unsigned long long *user_data,
+		int *res) {
+	unsigned head;
+	struct io_uring_cqe *cqe;
+
+	for (;;) {
+		head = *r->cq_head;
+		if (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+			cqe = &r->cqes[head & *r->cq_mask];
+			*user_data = cqe->user_data;
+			*res = cqe->res;
+			__atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+			return 0;
+		}
+
+		if (syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS,
+				NULL, 0) < 0 && errno != EINTR) {
+			return 1;
+		}
+	}
+}
+
+/***************** files ************************************************/
+
+struct ufile {
+	struct ring ring;
+	int fd;
+	int plain_fd; /* buffered descriptor for unaligned writes, or -1 */
+	int writing;
+	int fixed; /* buffers are registered */
+	int error;
+	char *mem;
+	char *buf[URING_DEPTH];
+	long long off[URING_DEPTH]; /* file offset of the buffer */
+	int len[URING_DEPTH]; /* bytes read into or to be written from it */
+	int state[URING_DEPTH];
+	int inflight;
+	int head; /* buffer being consumed or filled */
+	int used; /* bytes of the head buffer consumed by the reader */
+	long long pos; /* stream position */
+	long long next; /* offset of the next read ahead */
+};
+
+static int issue(struct ufile *f, int s, int opcode, int fixed_opcode) {
+	struct io_uring_sqe *sqe = ring_sqe(&f->ring);
+
+	sqe->opcode = f->fixed ? fixed_opcode : opcode;
+	sqe->fd = f->fd;
+	sqe->addr = (unsigned long long) (size_t) f->buf[s];
+	sqe->len = f->writing ? f->len[s] : URING_BLOCK;
+	sqe->off = f->off[s];
+	sqe->buf_index = s;
+	sqe->user_data = s;
+
+	if (ring_submit(&f->ring)) {
+		return 1;
+	}
+	f->state[s] = SLOT_BUSY;
+	f->inflight++;
+	return 0;
+}
+
+static int wait_one(struct ufile *f) {
+	unsigned long long s;
+	int res;
+
+	if (ring_wait(&f->ring, &s, &res) || s >= URING_DEPTH) {
+		f->error = 1;
+		return 1;
+	}
+	f->inflight--;
+
+	if (f->writing) {
+		if (res != f->len[s]) {
+			f->error = 1;
+		}
+		f->len[s] = 0;
+		f->state[s] = SLOT_IDLE;
+	} else {
+		f->len[s] = res;
+		f->state[s] = SLOT_DONE;
+		if (res < 0) {
+			f->error = 1;
+		}
+	}
+
+	return f->error;
+}
+
+static int drain(struct ufile *f) {
+	while (f->inflight > 0) {
+		if (wait_one(f)) {
+			while (f->inflight > 0 && !wait_one(f))
+				;
+			return 1;
+		}
+	}
+	return f->error;
+}
+
+/* Restarts the read ahead at a new position */
+static int read_from(struct ufile *f, long long pos) {
+	int s;
+
+	drain(f);
+	f->error = 0;
+	f->pos = pos;
+	f->next = pos;
+	f->head = 0;
+	f->used = 0;
+	for (s = 0; s < URING_DEPTH; s++) {
+		f->off[s] = f->next;
+		f->next += URING_BLOCK;
+		if (issue(f, s, IORING_OP_READ, IORING_OP_READ_FIXED)) {
+			f->error = 1;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static ssize_t cookie_read(void *cookie, char *out, size_t size) {
+	struct ufile *f = (struct ufile *) cookie;
+	int s, n;
+
+	for (;;) {
+		s = f->head;
+		while (f->state[s] == SLOT_BUSY) {
+			if (wait_one(f)) {
+				return -1;
+			}
+		}
+
+		if (f->used < f->len[s]) {
+			n = f->len[s] - f->used;
+			if ((size_t) n > size) {
+				n = (int) size;
+			}
+			memcpy(out, f->buf[s] + f->used, n);
+			f->used += n;
+			f->pos += n;
+			return n;
+		}
+
+		if (f->len[s] == 0) {
+			return 0;
+		}
+
+		if (f->len[s] < URING_BLOCK) {
+			/* a short read, read on from where it ended */
+			if (read_from(f, f->pos)) {
+				return -1;
+			}
+			continue;
+		}
+
+		f->off[s] = f->next;
+		f->next += URING_BLOCK;
+		if (issue(f, s, IORING_OP_READ, IORING_OP_READ_FIXED)) {
+			return -1;
+		}
+		f->head = (s + 1) % URING_DEPTH;
+		f->used = 0;
+	}
+}
+
+/*
+ * Writes the head buffer.  Unaligned writes to an O_DIRECT file are made
+ * through the buffered descriptor once nothing else is in flight.
+ */
+static int write_head(struct ufile *f) {
+	int s = f->head;
+
+	if (f->len[s] == 0) {
+		return 0;
+	}
+
+	if (f->plain_fd >= 0
+			&& (f->off[s] % DIRECT_ALIGN || f->len[s] % DIRECT_ALIGN)) {
+		if (drain(f) || pwrite(f->plain_fd, f->buf[s], f->len[s], f->off[s])
+				!= f->len[s]) {
+			f->error = 1;
+			return 1;
+		}
+		f->len[s] = 0;
+		return 0;
+	}
+
+	if (issue(f, s, IORING_OP_WRITE, IORING_OP_WRITE_FIXED)) {
+		f->error = 1;
+		return 1;
+	}
+
+	f->head = (s + 1) % URING_DEPTH;
+	while (f->state[f->head] == SLOT_BUSY) {
+		if (wait_one(f)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static ssize_t cookie_write(void *cookie, const char *in, size_t size) {
+	struct ufile *f = (struct ufile *) cookie;
+	size_t done = 0, n;
+	int s;
+
+	while (done < size) {
+		s = f->head;
+		if (f->len[s] == 0) {
+			f->off[s] = f->pos;
+		}
+
+		n = URING_BLOCK - f->len[s];
+		if (n > size - done) {
+			n = size - done;
+		}
+		memcpy(f->buf[s] + f->len[s], in + done, n);
+		f->len[s] += n;
+		f->pos += n;
+		done += n;
+
+		if (f->len[s] == URING_BLOCK && write_head(f)) {
+			return 0;
+		}
+	}
+
+	return done;
+}
+
+static int cookie_seek(void *cookie, off64_t *offset, int whence) {
+	struct ufile *f = (struct ufile *) cookie;
+	struct stat st;
+	long long target;
+
+	if (whence == SEEK_SET) {
+		target = *offset;
+	} else if (whence == SEEK_CUR) {
+		target = f->pos + *offset;
+	} else {
+		if (f->writing && (write_head(f) || drain(f))) {
+			return -1;
+		}
+		if (fstat(f->fd, &st)) {
+			return -1;
+		}
+		target = st.st_size + *offset;
+	}
+
+	if (target != f->pos) {
+		if (f->writing) {
+			if (write_head(f) || drain(f)) {
+				return -1;
+			}
+			f->pos = target;
+		} else if (read_from(f, target)) {
+			return -1;
+		}
+	}
+
+	*offset = target;
+	return 0;
+}
+
+static int cookie_close(void *cookie) {
+	struct ufile *f = (struct ufile *) cookie;
+	int error = 0;
+
+	if (f->writing) {
+		error = write_head(f);
+	}
+	error |= drain(f);
+
+	ring_exit(&f->ring);
+	if (f->plain_fd >= 0) {
+		close(f->plain_fd);
+	}
+	error |= close(f->fd) != 0;
+	free(f->mem);
+	free(f);
+
+	return error ? -1 : 0;
+}
+
+static FILE *uring_open(const char *path, int writing, int create,
+		int direct) {
+	struct ufile *f;
+	struct iovec iov[URING_DEPTH];
+	cookie_io_functions_t io = { cookie_read, cookie_write, cookie_seek,
+			cookie_close };
+	FILE *file;
+	void *mem;
+	int s, flags;
+
+	f = (struct ufile *) calloc(1, sizeof(struct ufile));
+	if (f == NULL) {
+		return NULL;
+	}
+	f->plain_fd = -1;
+	f->writing = writing;
+
+	if (ring_init(&f->ring, URING_DEPTH)) {
+		free(f);
+		return NULL;
+	}
+
+	if (posix_memalign(&mem, DIRECT_ALIGN, (size_t) URING_BLOCK * URING_DEPTH)) {
+		ring_exit(&f->ring);
+		free(f);
+		return NULL;
+	}
+	f->mem = (char *) mem;
+	for (s = 0; s < URING_DEPTH; s++) {
+		f->buf[s] = f->mem + (size_t) s * URING_BLOCK;
+		iov[s].iov_base = f->buf[s];
+		iov[s].iov_len = URING_BLOCK;
+	}
+
+	/* without registered buffers (memlock limits) plain reads and writes do */
+	f->fixed = syscall(__NR_io_uring_register, f->ring.fd,
+			IORING_REGISTER_BUFFERS, iov, URING_DEPTH) == 0;
+
+	if (!writing) {
+		f->fd = open(path, O_RDONLY);
+	} else {
+		flags = O_WRONLY | (create ? O_CREAT | O_TRUNC : 0);
+		f->fd = -1;
+		if (direct) {
+			f->fd = open(path, flags | O_DIRECT, 0666);
+			if (f->fd >= 0) {
+				f->plain_fd = open(path, O_WRONLY);
+				if (f->plain_fd < 0) {
+					close(f->fd);
+					f->fd = -1;
+				}
+			}
+		}
+		if (f->fd < 0) {
+			f->fd = open(path, flags, 0666);
+		}
+	}
+
+	if (f->fd < 0 || (!writing && read_from(f, 0))) {
+		if (f->fd >= 0) {
+			drain(f);
+			close(f->fd);
+		}
+		ring_exit(&f->ring);
+		free(f->mem);
+		free(f);
+		return NULL;
+	}
+
+	file = fopencookie(f, writing ? "w" : "r", io);
+	if (file == NULL) {
+		cookie_close(f);
+		return NULL;
+	}
+	setvbuf(file, NULL, _IOFBF, 65536);
+
+	return file;
+}
+
+#endif
+
+/*
+ * Opens a file for reading ("rb") or writing ("wb") with the given backend.
+ * "r+b" writes to an existing file, which io_uring can not also read.
+ * If io_uring is not available the file is opened with fopen().
+ */
+FILE *io_open(const char *path, const char *mode, int backend) {
+#ifdef HAVE_URING
+	static int unavailable;
+	FILE *file;
+	int writing = (mode[0] == 'w' || strchr(mode, '+') != NULL);
+
+	if (backend != IO_STDIO && !__atomic_load_n(&unavailable, __ATOMIC_RELAXED)
+			&& (writing || mode[0] == 'r')) {
+		file = uring_open(path, writing, mode[0] == 'w',
+				backend == IO_URING_DIRECT);
+		if (file != NULL) {
+			return file;
+		}
+
+		if (errno == ENOSYS || errno == EPERM || errno == ENOMEM) {
+			if (!__atomic_exchange_n(&unavailable, 1, __ATOMIC_RELAXED)) {
+				fprintf(stderr, "io_uring is not available, using stdio\n");
+			}
+		}
+	}
+#endif
+
+	return fopen(path, mode);
+}
+
+/* Bytes of buffers a file opened with the backend holds */
+long long io_buffer_size(int backend) {
+#ifdef HAVE_URING
+	if (backend != IO_STDIO) {
+		return (long long) URING_DEPTH * URING_BLOCK + 65536;
+	}
+#endif
+	return BUFSIZ;
+}
@@ -0,0 +1,53 @@
+/*
+ ***************************************************************************
+ *
+ * Author: Mike Hoolehan
+ *
+ * Copyright (C) 2013 Mike Hoolehan
+ *
+ * mike@hoolehan.com
+ *
+ * Optional io_uring backend for the csv input and the EDF output.  Files
+ * are opened as stdio streams, so the conversion code does not change;
+ * underneath, reads are issued ahead and writes behind, several at a time.
+ *
+ ***************************************************************************
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 2 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ ***************************************************************************
+ *
+ * This version of GPL is at http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ ***************************************************************************
+ */
+
+#ifndef uring_INCLUDED
+#define uring_INCLUDED
+
+#include <stdio.h>
+
+/* i/o backends for io_open() */
+#define IO_STDIO 0
+#define IO_URING 1
+#define IO_URING_DIRECT 2 /* io_uring, output written with O_DIRECT */
+
+/* Requests in flight per file and the size of each */
+#define URING_DEPTH 8
+#define URING_BLOCK (1 << 20)
+
+FILE *io_open(const char *path, const char *mode, int backend);
+long long io_buffer_size(int backend);
+
+#endif